@@ -0,0 +1,153 @@
+// Channel.h
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include "Scheduler.h"
+
+/*
+  Bounded ring-buffer channel from producers to one consumer task.
+
+   - the consumer is a persistent signalled task on a Scheduler: it is armed when
+     data arrives and gets every item as a view into its ring slot, no copy, no polling
+   - single producer by default (lock free), MultiProducer = true serialises
+     producers with a spinlock
+   - push() returns false when full (counted in dropped()); optional high/low
+     watermarks report backpressure to the producer side
+
+  Push from tasks or threads, not from an ISR (arming takes the scheduler lock).
+  Destroying the channel detaches it; the scheduler must outlive it.
+*/
+template<typename T, size_t N, bool MultiProducer = false>
+class Channel {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "Channel size must be a power of two");
+public:
+    typedef std::function<void(const T&)> Consumer;
+
+    Channel() {}
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+    ~Channel() { detach(); }
+
+    // Attach the consuming task. At most maxPerRun items are handed out per run,
+    // a remainder re-arms the task for the next loop(). Returns the task PID or 0.
+    PID_t attach(Scheduler& sched, Consumer consume, size_t maxPerRun = N) {
+        detach();
+        scheduler = &sched;
+        consumer = consume;
+        batchLimit = maxPerRun ? maxPerRun : N;
+        consumerPID = sched.addSignalledTask([this]() { consumeAvailable(); }, true);
+        if (consumerPID && !empty()) notifyConsumer();
+        return consumerPID;
+    }
+
+    void detach() {
+        if (scheduler && consumerPID) scheduler->removeTask(consumerPID);
+        consumerPID = 0;
+        scheduler = nullptr;
+        armed.store(false); // a removed consumer that was armed never clears it
+    }
+
+    // Copy item into the next slot. Returns false if the channel is full.
+    bool push(const T& item) {
+        if (MultiProducer) {
+            MuxGuard lock(&producerMux);
+            return pushLocked(item);
+        }
+        return pushLocked(item);
+    }
+
+    // Zero-copy produce (single producer only): fill the returned slot in place,
+    // then publish() it. Returns nullptr if the channel is full.
+    T* claim() {
+        static_assert(!MultiProducer, "claim()/publish() need a single producer");
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) {
+            droppedCount++;
+            return nullptr;
+        }
+        return &slots[h & (N - 1)];
+    }
+
+    void publish() {
+        static_assert(!MultiProducer, "claim()/publish() need a single producer");
+        head.fetch_add(1, std::memory_order_release);
+        afterPush();
+    }
+
+    // Backpressure: onPressure(true) once the fill level reaches high,
+    // onPressure(false) once the consumer drained it down to low
+    void setBackpressure(size_t high, size_t low, std::function<void(bool)> onPressure) {
+        highWater = high;
+        lowWater = low < high ? low : high - 1;
+        pressureCallback = onPressure;
+    }
+    bool pressured() const { return pressure.load(); }
+
+    size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    bool full() const { return size() >= N; }
+    static constexpr size_t capacity() { return N; }
+
+    // pushes rejected because the channel was full
+    uint32_t dropped() const { return droppedCount; }
+
+private:
+    bool pushLocked(const T& item) {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) {
+            droppedCount++;
+            return false;
+        }
+        slots[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        afterPush();
+        return true;
+    }
+
+    void afterPush() {
+        if (highWater && size() >= highWater && !pressure.exchange(true) && pressureCallback) {
+            pressureCallback(true);
+        }
+        notifyConsumer();
+    }
+
+    // arm the consumer once per batch of pushes, the consumer clears the flag before draining
+    void notifyConsumer() {
+        if (!consumerPID || armed.exchange(true)) return;
+        if (!scheduler->signalTask(consumerPID)) armed.store(false); // task gone, e.g. stop()
+    }
+
+    void consumeAvailable() {
+        armed.store(false);
+        size_t n = 0;
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        while (n < batchLimit && t != head.load(std::memory_order_acquire)) {
+            if (consumer) consumer(slots[t & (N - 1)]); // view into the slot
+            tail.store(++t, std::memory_order_release);
+            n++;
+        }
+        if (pressure.load() && size() <= lowWater && pressure.exchange(false) && pressureCallback) {
+            pressureCallback(false);
+        }
+        if (!empty()) notifyConsumer(); // over batchLimit => next loop()
+    }
+
+    T slots[N];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<bool> armed{false};
+    std::atomic<bool> pressure{false};
+    uint32_t droppedCount = 0;
+
+    size_t highWater = 0; // 0 => no backpressure signalling
+    size_t lowWater = 0;
+    std::function<void(bool)> pressureCallback;
+
+    Scheduler* scheduler = nullptr;
+    PID_t consumerPID = 0;
+    Consumer consumer;
+    size_t batchLimit = N;
+
+    portMUX_TYPE producerMux = portMUX_INITIALIZER_UNLOCKED;
+};
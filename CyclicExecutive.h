@@ -0,0 +1,202 @@
+// CyclicExecutive.h
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include "Scheduler.h"
+
+/*
+  Cyclic executive for the hard-periodic part of an application.
+
+  Entries (period, phase, worst-case execution time) are compiled by build()
+  into a frame table: the minor frame is the gcd of all periods and phases
+  (or given), the major frame the lcm of the periods. Dispatching a minor frame
+  walks its slice of the table, there are no deadline comparisons.
+  Periods or phases that don't fit the minor frame, frames whose summed WCET
+  exceeds the minor frame and oversized tables are reported by build().
+
+  start() hosts the table on a Scheduler with one persistent signalled task,
+  re-armed against an absolute frame clock so frames don't drift. Frames that
+  are missed because loop() came too late are skipped and counted as overruns.
+*/
+class CyclicExecutive {
+public:
+    enum class BuildStatus : uint8_t {
+        Ok,
+        NoEntries,
+        BadPeriod,     // period is 0 or not a multiple of the minor frame
+        BadPhase,      // phase >= period or not a multiple of the minor frame
+        FrameOverrun,  // summed WCET of a frame exceeds the minor frame
+        TableTooLarge  // major / minor frame exceeds maxFrames, or the major frame 32 bits of ms
+    };
+
+    static const char* statusText(BuildStatus s) {
+        switch (s) {
+            case BuildStatus::Ok:            return "ok";
+            case BuildStatus::NoEntries:     return "no entries";
+            case BuildStatus::BadPeriod:     return "period not a multiple of the minor frame";
+            case BuildStatus::BadPhase:      return "phase not below period or not a multiple of the minor frame";
+            case BuildStatus::FrameOverrun:  return "frame WCET exceeds minor frame";
+            case BuildStatus::TableTooLarge: return "frame table too large";
+        }
+        return "unknown";
+    }
+
+    // Register an entry before build(). Returns its index.
+    size_t addEntry(std::function<void()> fn, uint32_t periodMs, uint32_t phaseMs = 0, uint32_t wcetUs = 0) {
+        Entry e;
+        e.fn = fn;
+        e.period = periodMs;
+        e.phase = phaseMs;
+        e.wcetUs = wcetUs;
+        entries.push_back(e);
+        built = false;
+        return entries.size() - 1;
+    }
+
+    // minorFrameMs == 0 => gcd of all periods and phases.
+    // On failure failedEntry() / failedFrame() tell which one is at fault.
+    BuildStatus build(uint32_t minorFrameMs = 0, size_t maxFrames = 64) {
+        built = false;
+        badEntry = badFrame = SIZE_MAX;
+        table.clear();
+        frameStart.clear();
+        if (entries.empty()) return BuildStatus::NoEntries;
+        if (entries.size() > 256) return BuildStatus::TableTooLarge;
+
+        uint32_t minor = minorFrameMs;
+        uint64_t major = 1; // > UINT32_MAX => the hyperperiod does not fit the ms clock
+        for (size_t i = 0; i < entries.size(); i++) {
+            const Entry& e = entries[i];
+            if (!e.period) { badEntry = i; return BuildStatus::BadPeriod; }
+            if (!minorFrameMs) minor = gcd(gcd(minor, e.period), e.phase);
+            if (major <= UINT32_MAX) major = lcm((uint32_t)major, e.period);
+        }
+        for (size_t i = 0; i < entries.size(); i++) {
+            const Entry& e = entries[i];
+            if (e.period % minor) { badEntry = i; return BuildStatus::BadPeriod; }
+            if (e.phase >= e.period || e.phase % minor) { badEntry = i; return BuildStatus::BadPhase; }
+        }
+        if (major > UINT32_MAX || major / minor > maxFrames) return BuildStatus::TableTooLarge;
+        const size_t frames = major / minor;
+
+        frameStart.reserve(frames + 1);
+        for (size_t f = 0; f < frames; f++) {
+            frameStart.push_back(table.size());
+            const uint32_t t = f * minor;
+            uint64_t frameWcet = 0; // up to 256 entries of 32 bit WCETs
+            for (size_t i = 0; i < entries.size(); i++) {
+                const Entry& e = entries[i];
+                if (t < e.phase || (t - e.phase) % e.period) continue;
+                table.push_back(i);
+                frameWcet += e.wcetUs;
+            }
+            if (frameWcet > (uint64_t)minor * 1000) {
+                badFrame = f;
+                table.clear();
+                frameStart.clear();
+                return BuildStatus::FrameOverrun;
+            }
+        }
+        frameStart.push_back(table.size());
+        if (table.size() > UINT16_MAX) {
+            table.clear();
+            frameStart.clear();
+            return BuildStatus::TableTooLarge;
+        }
+
+        minorMs = minor;
+        majorMs = major;
+        built = true;
+        return BuildStatus::Ok;
+    }
+
+    size_t failedEntry() const { return badEntry; }
+    size_t failedFrame() const { return badFrame; }
+
+    // Host the table on sched, first frame right away. Needs a successful build().
+    PID_t start(Scheduler& sched) {
+        if (!built) return 0;
+        stop();
+        scheduler = &sched;
+        framePID = sched.addSignalledTask([this]() { onFrame(); }, true);
+        if (!framePID) {
+            scheduler = nullptr;
+            return 0;
+        }
+        frame = 0;
+        nextFrameAt = millis();
+        sched.signalTask(framePID);
+        return framePID;
+    }
+
+    void stop() {
+        if (scheduler && framePID) scheduler->removeTask(framePID);
+        scheduler = nullptr;
+        framePID = 0;
+    }
+
+    // Run the entries of the current minor frame and advance; O(entries in the frame)
+    void dispatchFrame() {
+        if (!built) return;
+        for (uint16_t k = frameStart[frame]; k < frameStart[frame + 1]; k++) {
+            entries[table[k]].fn();
+        }
+        if (++frame == frameStart.size() - 1) frame = 0;
+    }
+
+    uint32_t minorFrame() const { return minorMs; }
+    uint32_t majorFrame() const { return majorMs; }
+    size_t frames() const { return built ? frameStart.size() - 1 : 0; }
+    // frames skipped at run time because dispatch came too late
+    uint32_t frameOverruns() const { return overruns; }
+
+private:
+    struct Entry {
+        std::function<void()> fn;
+        uint32_t period = 0;
+        uint32_t phase = 0;
+        uint32_t wcetUs = 0;
+    };
+
+    static uint32_t gcd(uint32_t a, uint32_t b) {
+        while (b) {
+            const uint32_t r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+    static uint64_t lcm(uint32_t a, uint32_t b) { return (uint64_t)(a / gcd(a, b)) * b; }
+
+    void onFrame() {
+        dispatchFrame();
+        nextFrameAt += minorMs;
+        int32_t left = (int32_t)(nextFrameAt - millis());
+        const uint32_t missed = left < 0 ? (uint32_t)(-left) / minorMs : 0;
+        if (missed) {
+            // a whole frame or more behind => skip those frames to stay in phase
+            overruns += missed;
+            frame = (frame + missed) % (frameStart.size() - 1);
+            nextFrameAt += missed * minorMs;
+            left = (int32_t)(nextFrameAt - millis());
+        }
+        scheduler->signalTask(framePID, left > 0 ? left : 0);
+    }
+
+    std::vector<Entry> entries;
+    std::vector<uint8_t> table;       // entry indices, frame by frame
+    std::vector<uint16_t> frameStart; // frame f spans table[frameStart[f] .. frameStart[f + 1])
+    bool built = false;
+    uint32_t minorMs = 0;
+    uint32_t majorMs = 0;
+    size_t badEntry = SIZE_MAX;
+    size_t badFrame = SIZE_MAX;
+
+    size_t frame = 0;
+    uint32_t nextFrameAt = 0;
+    uint32_t overruns = 0;
+
+    Scheduler* scheduler = nullptr;
+    PID_t framePID = 0;
+};
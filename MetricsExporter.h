@@ -0,0 +1,264 @@
+// MetricsExporter.h
+#pragma once
+#include <Arduino.h>
+#include <stdio.h>
+#include "Scheduler.h"
+
+/*
+  Streams the global and per-task metrics of a Scheduler to a byte sink.
+  Sink is anything with size_t write(const uint8_t*, size_t): an Arduino Print/Stream,
+  a File, or a small stdout wrapper on host.
+
+  RAM is bounded: the global metrics are snapshot when an export begins, then the
+  task list is walked by index a few tasks per step() (Scheduler::taskStats()),
+  with a line buffer on the stack. Tasks added or removed during an export may be
+  skipped or reported twice.
+
+  Formats:
+   - Text: Prometheus exposition format, counters as *_total, one series per task
+     labelled pid="<PID>". Per-task families are emitted one after the other, each
+     walking the whole task list, so the samples of a family stay together
+   - Binary: 'S' 'M' <version 1>, then records of <type byte> + unsigned LEB128 varints:
+       0x01 global: elapsedMs loopCalls workCalls wakeups dispatched conditionEvals
+                    timeouts busyUs shedRuns watchdogOverruns watchdogTrips
+                    maxLoopGapUs starvedGaps taskCount
+       0x02 task:   PID runs worstExecUs overruns priority interval
+       0x00 end of export
+
+  Either call exportAll() on demand, or start() a periodic export from a persistent
+  signalled task (never shed under overload) that emits tasksPerRun tasks per loop() call.
+  The exporter must outlive its task (call stop() before destroying it).
+*/
+template<typename Sink = Print>
+class MetricsExporter {
+public:
+    enum Format : uint8_t { TEXT, BINARY };
+
+    MetricsExporter(Scheduler& sched, Sink& out, Format format = TEXT)
+      : scheduler(sched), sink(out), format(format) {}
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+    ~MetricsExporter() { stop(); }
+
+    void setFormat(Format f) { format = f; stage = IDLE; }
+
+    // Emit the next part of the current export, starting a new one if none is running.
+    // Returns true once the export is complete.
+    bool step(size_t tasksPerStep = 8) {
+        if (stage == IDLE) begin();
+        if (stage == GLOBAL) {
+            if (format == TEXT) writeGlobalText();
+            else writeGlobalBinary();
+            stage = TASKS;
+            taskIndex = 0;
+            family = 0;
+            return false;
+        }
+        Scheduler::TaskStats ts;
+        for (size_t n = 0; n < tasksPerStep; n++) {
+            if (format == TEXT && taskIndex == 0) writeFamilyType();
+            if (!scheduler.taskStats(taskIndex, ts)) {
+                // text: the next family starts over at the first task
+                if (format == TEXT && ++family < TASK_FAMILIES) {
+                    taskIndex = 0;
+                    continue;
+                }
+                if (format == BINARY) putByte(0x00);
+                stage = IDLE;
+                return true;
+            }
+            taskIndex++;
+            if (format == TEXT) writeTaskText(ts);
+            else writeTaskBinary(ts);
+        }
+        return false;
+    }
+
+    // Complete export in one go
+    void exportAll() {
+        stage = IDLE;
+        while (!step(SIZE_MAX)) {}
+    }
+
+    // Export every periodMs from a PRIORITY_LOW task of the scheduler
+    PID_t start(uint32_t periodMs, size_t tasksPerRun = 8) {
+        stop();
+        period = periodMs;
+        chunk = tasksPerRun ? tasksPerRun : 1;
+        PID = scheduler.addSignalledTask([this]() { onRun(); }, true);
+        if (!PID) return 0;
+        scheduler.setTaskPriority(PID, Scheduler::PRIORITY_LOW);
+        stage = IDLE;
+        scheduler.signalTask(PID);
+        return PID;
+    }
+
+    void stop() {
+        if (PID) scheduler.removeTask(PID);
+        PID = 0;
+    }
+
+    uint32_t exports() const { return completed; }
+
+private:
+    enum Stage : uint8_t { IDLE, GLOBAL, TASKS };
+    // per-task metric families of the text format, in output order
+    static const uint8_t TASK_FAMILIES = 4;
+
+    void begin() {
+        global = scheduler.metrics();
+        overload = scheduler.overloadStatus();
+        gaps = scheduler.loopGapStats();
+        tasks = scheduler.taskCount();
+        stage = GLOBAL;
+        if (format == BINARY) {
+            const uint8_t header[3] = { 'S', 'M', 1 };
+            sink.write(header, sizeof(header));
+        }
+    }
+
+    void onRun() {
+        if (step(chunk)) {
+            completed++;
+            scheduler.signalTask(PID, period);
+        } else {
+            scheduler.signalTask(PID); // rest in the next loop() call
+        }
+    }
+
+    // 0 when built without SCHEDULER_WATCHDOG, the binary layout stays the same
+    uint32_t watchdogOverruns() const {
+#if SCHEDULER_WATCHDOG
+        return scheduler.watchdogOverrunCount();
+#else
+        return 0;
+#endif
+    }
+    uint32_t watchdogTrips() const {
+#if SCHEDULER_WATCHDOG
+        return scheduler.watchdogTripCount();
+#else
+        return 0;
+#endif
+    }
+
+    // text format
+    void writeText(const char* line) {
+        sink.write((const uint8_t*)line, strlen(line));
+    }
+    // names are written as they are, only numbers go through the buffer
+    void counter(const char* name, unsigned long long value, const char* type = "counter") {
+        char num[24];
+        writeText("# TYPE scheduler_");
+        writeText(name);
+        writeText(" ");
+        writeText(type);
+        writeText("\nscheduler_");
+        writeText(name);
+        snprintf(num, sizeof(num), " %llu\n", value);
+        writeText(num);
+    }
+    void taskSeries(const char* name, PID_t pid, unsigned long value) {
+        char num[48];
+        writeText("scheduler_task_");
+        writeText(name);
+        snprintf(num, sizeof(num), "{pid=\"%lu\"} %lu\n", (unsigned long)pid, value);
+        writeText(num);
+    }
+    void writeGlobalText() {
+        counter("elapsed_ms", global.elapsedMs, "gauge");
+        counter("loop_calls_total", global.loopCalls);
+        counter("work_calls_total", global.workCalls);
+        counter("wakeups_total", global.wakeups);
+        counter("dispatched_total", global.dispatched);
+        counter("condition_evaluations_total", global.conditionEvals);
+        counter("timeouts_total", global.timeouts);
+        counter("busy_us_total", global.busyUs);
+        counter("shed_runs_total", overload.shedRuns);
+        counter("watchdog_overruns_total", watchdogOverruns());
+        counter("watchdog_trips_total", watchdogTrips());
+        counter("max_loop_gap_us", gaps.maxGapUs, "gauge");
+        counter("starved_gaps_total", gaps.starved);
+        counter("overloaded", overload.overloaded, "gauge");
+        counter("tasks", tasks, "gauge");
+    }
+    void writeFamilyType() {
+        static const char* const types[TASK_FAMILIES] = {
+            "# TYPE scheduler_task_runs_total counter\n",
+            "# TYPE scheduler_task_worst_exec_us gauge\n",
+            "# TYPE scheduler_task_overruns_total counter\n",
+            "# TYPE scheduler_task_interval_ms gauge\n"
+        };
+        writeText(types[family]);
+    }
+    // the sample of the current family
+    void writeTaskText(const Scheduler::TaskStats& ts) {
+        switch (family) {
+            case 0: taskSeries("runs_total", ts.PID, ts.runs); break;
+            case 1: taskSeries("worst_exec_us", ts.PID, ts.worstExecUs); break;
+            case 2: taskSeries("overruns_total", ts.PID, ts.overruns); break;
+            default: taskSeries("interval_ms", ts.PID, ts.interval); break;
+        }
+    }
+
+    // binary format
+    void putByte(uint8_t b) { sink.write(&b, 1); }
+    // unsigned LEB128 into buf, returns the new write position
+    static size_t varint(uint8_t* buf, size_t pos, uint64_t v) {
+        while (v >= 0x80) {
+            buf[pos++] = (uint8_t)v | 0x80;
+            v >>= 7;
+        }
+        buf[pos++] = (uint8_t)v;
+        return pos;
+    }
+    void writeGlobalBinary() {
+        uint8_t buf[1 + 14 * 10];
+        size_t n = 0;
+        buf[n++] = 0x01;
+        n = varint(buf, n, global.elapsedMs);
+        n = varint(buf, n, global.loopCalls);
+        n = varint(buf, n, global.workCalls);
+        n = varint(buf, n, global.wakeups);
+        n = varint(buf, n, global.dispatched);
+        n = varint(buf, n, global.conditionEvals);
+        n = varint(buf, n, global.timeouts);
+        n = varint(buf, n, global.busyUs);
+        n = varint(buf, n, overload.shedRuns);
+        n = varint(buf, n, watchdogOverruns());
+        n = varint(buf, n, watchdogTrips());
+        n = varint(buf, n, gaps.maxGapUs);
+        n = varint(buf, n, gaps.starved);
+        n = varint(buf, n, tasks);
+        sink.write(buf, n);
+    }
+    void writeTaskBinary(const Scheduler::TaskStats& ts) {
+        uint8_t buf[1 + 6 * 5];
+        size_t n = 0;
+        buf[n++] = 0x02;
+        n = varint(buf, n, ts.PID);
+        n = varint(buf, n, ts.runs);
+        n = varint(buf, n, ts.worstExecUs);
+        n = varint(buf, n, ts.overruns);
+        n = varint(buf, n, ts.priority);
+        n = varint(buf, n, ts.interval);
+        sink.write(buf, n);
+    }
+
+    Scheduler& scheduler;
+    Sink& sink;
+    Format format;
+
+    Stage stage = IDLE;
+    size_t taskIndex = 0;
+    uint8_t family = 0; // text format: per-task family being walked
+    Scheduler::Metrics global;
+    Scheduler::OverloadStatus overload;
+    Scheduler::LoopGapStats gaps;
+    size_t tasks = 0;
+
+    PID_t PID = 0;
+    uint32_t period = 0;
+    size_t chunk = 8;
+    uint32_t completed = 0;
+};
@@ -0,0 +1,40 @@
+// ProfileReport.h
+#pragma once
+#include <Arduino.h>
+#include <stdio.h>
+#include "Scheduler.h"
+
+#if !SCHEDULER_PROFILING
+#error "ProfileReport.h needs SCHEDULER_PROFILING"
+#endif
+
+/*
+  "top"-style rendering of Scheduler::profileTop(): the N heaviest tasks by key
+  over the sliding profile window, one line each. Out is anything with
+  size_t write(const uint8_t*, size_t) (Print/Stream, or a stdout wrapper on host).
+  RAM: N entries plus a line buffer on the stack. Needs enableProfiling().
+*/
+template<size_t N = 8, typename Out = Print>
+size_t printProfile(Out& out, const Scheduler& sched, Scheduler::ProfileKey key = Scheduler::PROFILE_EXEC) {
+    Scheduler::ProfileEntry top[N];
+    const size_t n = sched.profileTop(top, N, key);
+    const uint32_t windowMs = sched.profilingWindow();
+    char line[112];
+
+    static const char* const keyNames[] = { "exec time", "condition time", "rate", "lateness" };
+    int len = snprintf(line, sizeof(line), "top %u by %s, window %lu ms\n"
+                       "  PID    exec_us  cpu%%    cond_us    runs/s  late_ms\n",
+                       (unsigned)n, keyNames[key < 4 ? key : 0], (unsigned long)windowMs);
+    out.write((const uint8_t*)line, len < (int)sizeof(line) ? len : sizeof(line) - 1);
+
+    for (size_t i = 0; i < n; i++) {
+        const Scheduler::ProfileEntry& e = top[i];
+        const float cpu = windowMs ? e.execUs / (windowMs * 10.0f) : 0.0f;
+        const float rate = windowMs ? e.runs * 1000.0f / windowMs : 0.0f;
+        len = snprintf(line, sizeof(line), "%5u %10lu %5.1f %10lu %9.1f %8lu\n",
+                       (unsigned)e.PID, (unsigned long)e.execUs, cpu, (unsigned long)e.conditionUs,
+                       rate, (unsigned long)e.maxLatenessMs);
+        out.write((const uint8_t*)line, len < (int)sizeof(line) ? len : sizeof(line) - 1);
+    }
+    return n;
+}
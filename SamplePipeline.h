@@ -0,0 +1,145 @@
+// SamplePipeline.h
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <utility>
+#include "Scheduler.h"
+
+// View on the samples of one batch; the ring may wrap, so it is up to two spans
+template<typename T>
+struct SampleBatch {
+    const T* first = nullptr;
+    size_t firstCount = 0;
+    const T* second = nullptr;
+    size_t secondCount = 0;
+
+    size_t size() const { return firstCount + secondCount; }
+    const T& operator[](size_t i) const {
+        return i < firstCount ? first[i] : second[i - firstCount];
+    }
+};
+
+/*
+  Two-stage acquisition pipeline on a Scheduler:
+
+   - acquisition: a repeating timed task every sampleIntervalMs that writes
+     the sample straight into a fixed ring slot
+   - batch: a persistent signalled task, armed once batchSamples samples are
+     buffered or batchMs after the first sample of a batch, whichever is first.
+     It gets all buffered samples in one call.
+
+  Both stages run inside Scheduler::loop(), so the ring needs no locking.
+  When the ring is full the oldest sample is overwritten and counted as overrun;
+  a sample that then fails leaves it intact.
+  The pipeline must outlive its tasks (call end() before destroying it).
+*/
+template<typename T, size_t N>
+class SamplePipeline {
+public:
+    // fill the slot, return false if there is no sample this time
+    typedef std::function<bool(T&)> Sampler;
+    typedef std::function<void(const SampleBatch<T>&)> BatchProcessor;
+
+    struct Metrics {
+        uint32_t samples = 0;   // samples acquired
+        uint32_t batches = 0;   // batch stage runs
+        uint32_t overruns = 0;  // samples overwritten before the batch stage got them
+        uint16_t fill = 0;      // samples currently buffered
+        uint16_t maxFill = 0;   // high-water mark of fill
+        uint16_t lastBatch = 0; // size of the last batch
+    };
+
+    SamplePipeline() {}
+    SamplePipeline(const SamplePipeline&) = delete;
+    SamplePipeline& operator=(const SamplePipeline&) = delete;
+
+    // batchSamples is capped to N; batchMs == 0 => only the sample count arms the batch
+    bool begin(Scheduler& sched, uint32_t sampleIntervalMs, Sampler sample,
+               size_t batchSamples, uint32_t batchMs, BatchProcessor process) {
+        end();
+        scheduler = &sched;
+        sampler = sample;
+        processor = process;
+        batchCount = (batchSamples == 0 || batchSamples > N) ? N : batchSamples;
+        batchTimeout = batchMs;
+
+        batchPID = sched.addSignalledTask([this]() { runBatch(); }, true);
+        acquirePID = sched.addTimedTask([this]() { acquire(); }, sampleIntervalMs, true, sampleIntervalMs);
+        if (!batchPID || !acquirePID) {
+            end();
+            return false;
+        }
+        return true;
+    }
+
+    void end() {
+        if (scheduler) {
+            if (acquirePID) scheduler->removeTask(acquirePID);
+            if (batchPID) scheduler->removeTask(batchPID);
+        }
+        acquirePID = batchPID = 0;
+        scheduler = nullptr;
+    }
+
+    Metrics metrics() const {
+        Metrics m = stats;
+        m.fill = count;
+        return m;
+    }
+    void resetMetrics() { stats = Metrics(); }
+
+    size_t fill() const { return count; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    void acquire() {
+        if (!sampler) return;
+        if (count == N) { // full: a failed sample must not clobber the oldest
+            T sample;
+            if (!sampler(sample)) return;
+            ring[start] = std::move(sample); // overwrite the oldest
+            start = (start + 1) % N;
+            stats.overruns++;
+        } else {
+            if (!sampler(ring[(start + count) % N])) return;
+            count++;
+        }
+        stats.samples++;
+        if (count > stats.maxFill) stats.maxFill = count;
+
+        if (count >= batchCount) {
+            scheduler->signalTask(batchPID);
+        } else if (count == 1 && batchTimeout) {
+            scheduler->signalTask(batchPID, batchTimeout); // first sample => batch deadline
+        }
+    }
+
+    void runBatch() {
+        if (!count) return;
+        SampleBatch<T> batch;
+        batch.first = &ring[start];
+        batch.firstCount = (start + count <= N) ? count : N - start;
+        batch.second = ring;
+        batch.secondCount = count - batch.firstCount;
+
+        stats.batches++;
+        stats.lastBatch = count;
+        if (processor) processor(batch);
+        start = (start + count) % N;
+        count = 0;
+    }
+
+    T ring[N];
+    size_t start = 0;
+    size_t count = 0;
+
+    size_t batchCount = N;
+    uint32_t batchTimeout = 0;
+    Sampler sampler;
+    BatchProcessor processor;
+    Metrics stats;
+
+    Scheduler* scheduler = nullptr;
+    PID_t acquirePID = 0;
+    PID_t batchPID = 0;
+};
@@ -0,0 +1,84 @@
+// ScheduleAnalysis.h
+#pragma once
+// Plain C++ on purpose (no Arduino.h), so the host CLI in tools/ can use it as well
+#include <stdint.h>
+#include <vector>
+
+/*
+  Offline schedulability analysis for the repeating tasks of a Scheduler.
+
+  Model of the dispatch policy: loop() is non-preemptive; it collects every due
+  task and runs them in task order. So in the worst case
+
+   - the burst of one loop() is the loop overhead plus the WCET of all tasks
+   - a task that becomes due just after a loop() started its collection waits
+     for that whole burst, then for the tasks before it in the next loop():
+         response_i = burst + overhead + sum_{j <= i} wcet_j
+   - a task meets its period if response_i <= period_i
+   - a tick overloads if the burst exceeds the shortest period
+
+  Tasks must be given in dispatch (task) order, see Scheduler::collectPeriodicTasks().
+  Indexed builds (SCHEDULER_INDEXED) run due tasks in deadline order instead: the
+  task that just became due has the latest deadline and may run after all others,
+  so with deadlineOrder every task waits for two whole bursts:
+         response_i = 2 * burst
+*/
+struct AnalysisTask {
+    uint32_t id;
+    uint32_t periodMs;
+    uint32_t wcetUs;
+};
+
+struct TaskVerdict {
+    uint32_t id;
+    uint32_t periodMs;
+    uint32_t wcetUs;
+    uint32_t responseUs;  // worst-case response time bound
+    bool meetsPeriod;
+};
+
+struct AnalysisReport {
+    float utilization = 0;     // sum of wcet / period
+    uint32_t burstUs = 0;      // worst-case loop() burst
+    bool overUtilized = false; // utilization above the bound
+    bool tickOverload = false; // burst longer than the shortest period
+    bool schedulable = false;  // none of the above and every task meets its period
+    std::vector<TaskVerdict> tasks;
+};
+
+inline AnalysisReport analyzeSchedule(const std::vector<AnalysisTask>& tasks,
+                                      uint32_t loopOverheadUs = 0,
+                                      float utilizationBound = 1.0f,
+                                      bool deadlineOrder = false) {
+    AnalysisReport r;
+    uint64_t burst = loopOverheadUs;
+    uint64_t shortestUs = UINT64_MAX;
+    for (const AnalysisTask& t : tasks) {
+        burst += t.wcetUs;
+        if (t.periodMs) {
+            r.utilization += (float)t.wcetUs / (t.periodMs * 1000.0f);
+            if (t.periodMs * 1000ULL < shortestUs) shortestUs = t.periodMs * 1000ULL;
+        }
+    }
+    r.burstUs = burst > UINT32_MAX ? UINT32_MAX : (uint32_t)burst;
+    r.overUtilized = r.utilization > utilizationBound;
+    r.tickOverload = !tasks.empty() && burst > shortestUs;
+
+    bool allMet = true;
+    uint64_t before = loopOverheadUs;
+    r.tasks.reserve(tasks.size());
+    for (const AnalysisTask& t : tasks) {
+        before += t.wcetUs;
+        const uint64_t response = burst + (deadlineOrder ? burst : before);
+        TaskVerdict v;
+        v.id = t.id;
+        v.periodMs = t.periodMs;
+        v.wcetUs = t.wcetUs;
+        v.responseUs = response > UINT32_MAX ? UINT32_MAX : (uint32_t)response;
+        v.meetsPeriod = t.periodMs && response <= t.periodMs * 1000ULL;
+        allMet = allMet && v.meetsPeriod;
+        r.tasks.push_back(v);
+    }
+    r.schedulable = allMet && !r.overUtilized && !r.tickOverload;
+    return r;
+}
@@ -1,62 +1,419 @@
 #include "Scheduler.h"
+#include "TokenBucket.h"
 #include <LoggingBase.h>
 
-//#define HIGHLY_VERBOSE
-#define MAX_TASKS 124
+static_assert((uint64_t)(PID_t)~(PID_t)0 > SCHEDULER_MAX_TASKS, "PID_t too small for SCHEDULER_MAX_TASKS");
+
+#if SCHEDULER_WATCHDOG
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+#define CRASH_RECORD_MAGIC 0x53434852UL
+
+// survives a watchdog reset on ESP32, plain RAM elsewhere
+#ifdef RTC_NOINIT_ATTR
+RTC_NOINIT_ATTR static SchedulerCrashRecord crashRecord;
+#else
+static SchedulerCrashRecord crashRecord;
+#endif
+#endif
 
 Scheduler::Scheduler() {
-    tasks.reserve(MAX_TASKS);
+    counters.startMs = millis();
+    tasks.reserve(SCHEDULER_MAX_TASKS < 128 ? SCHEDULER_MAX_TASKS : 128); // grows beyond on large builds
+    timeoutHeap.reserve(16);
     tasksToRemove.reserve(8);
 }
 
 void Scheduler::clearMarkedForRemoval(bool alreadyLocked) {
     MuxGuard lock(&schedMux, !alreadyLocked);
     for(auto pid : tasksToRemove){
-        //find task with pid
-        auto it = std::find_if(tasks.begin(), tasks.end(), [pid](const Task &t) { return t.PID == pid; });
-        if (it != tasks.end()) {
-            tasks.erase(it);//remove it if it exists
-        }
+        eraseTask(pid);//remove it if it exists
     }
     tasksToRemove.clear();
 }
 
+void Scheduler::insertTask(const Task& t) {
+    tasks.push_back(t);
+    tasks.back().loadPpm = 0;
+    updateLoad(tasks.back());
+#if SCHEDULER_INDEXED
+    pidIndex[t.PID] = tasks.size() - 1;
+    if (t.child) children.push_back(t.PID);
+    else if (!t.signalled) toArm.push_back(t.PID);
+#endif
+}
+
+bool Scheduler::eraseTask(PID_t pid) {
+#if SCHEDULER_INDEXED
+    // swap with the last task, O(1); heap and list entries of pid become stale
+    const auto it = pidIndex.find(pid);
+    if (it == pidIndex.end()) return false;
+    const size_t pos = it->second;
+    pidIndex.erase(it);
+    repeatingLoadPpm -= tasks[pos].loadPpm;
+    if (pos + 1 != tasks.size()) {
+        tasks[pos] = std::move(tasks.back());
+        pidIndex[tasks[pos].PID] = pos;
+    }
+    tasks.pop_back();
+    return true;
+#else
+    for (auto it = tasks.begin(); it != tasks.end(); ++it) {
+        if (it->PID == pid) {
+            repeatingLoadPpm -= it->loadPpm;
+            tasks.erase(it);
+            return true;
+        }
+    }
+    return false;
+#endif
+}
+
+#if SCHEDULER_INDEXED
+void Scheduler::armed(Task& t, uint32_t now) {
+    t.armGen = ++armSeq;
+    uint32_t at = t.executeAt;
+    if (t.bucket) {
+        // rate limited => not due before the next token
+        const uint32_t tokenAt = now + t.bucket->msUntilToken(now);
+        if ((int32_t)(tokenAt - at) > 0) at = tokenAt;
+    }
+    scheduleExecution(t, at);
+}
+
+// drop stale heap entries once they outnumber the tasks, keeps the heaps O(tasks)
+void Scheduler::compactHeaps() {
+    const size_t limit = 2 * tasks.size() + 64;
+    if (execHeap.size() > limit) {
+        size_t w = 0;
+        for (const ExecEntry& e : execHeap) {
+            if (isLive(e)) execHeap[w++] = e;
+        }
+        execHeap.resize(w);
+        std::make_heap(execHeap.begin(), execHeap.end(), ExecEntry::later);
+    }
+    if (timeoutHeap.size() > limit) {
+        size_t w = 0;
+        for (const TimeoutEntry& e : timeoutHeap) {
+            const Task* t = findTask(e.PID);
+            if (t && !t->conditionMet && t->conditionDeadline == e.deadline) timeoutHeap[w++] = e;
+        }
+        timeoutHeap.resize(w);
+        std::make_heap(timeoutHeap.begin(), timeoutHeap.end(), TimeoutEntry::later);
+    }
+}
+#endif
+
 PID_t Scheduler::getAndIncrementPID() {
-    // this is not very efficient, but ok for now for small number of tasks
+    // a lookup per candidate: a scan for the plain task list, O(1) when indexed
     // Safeguard: if nextPID is 0, set it to 1
     if (!nextPID) {
         nextPID = 1;
     }
 
     // Keep trying until we find a PID that does not collide
-    bool collision;
-
     MuxGuard lock(&schedMux);
-    do {
-        collision = false;
-        for (const auto& t : tasks) {
-            if (t.PID == nextPID) {
-                // If collision, increment PID and wrap if needed
-                nextPID++;
-                if (!nextPID) {
-                    nextPID = 1;
-                }
-                collision = true;
-                break;  // Break out and re-check from the beginning
-            }
+    while (findTask(nextPID)) {
+        // If collision, increment PID and wrap if needed
+        nextPID++;
+        if (!nextPID) {
+            nextPID = 1;
         }
-    } while (collision);
+    }
 
     // Now nextPID is free for sure
     return nextPID++;
 }
 
+void Scheduler::setConditionBudget(uint16_t maxEvaluations, uint32_t maxMicros) {
+    MuxGuard lock(&schedMux);
+    conditionBudgetCount = maxEvaluations;
+    conditionBudgetUs = maxMicros;
+}
+
+void Scheduler::setOverloadManagement(const OverloadConfig& config, std::function<void(bool)> onChange) {
+    MuxGuard lock(&schedMux);
+    overloadConfig = config;
+    if (!overloadConfig.windowMs) overloadConfig.windowMs = 1;
+    // an exit threshold of 0 could never be reached, one above enter would flap
+    OverloadConfig& c = overloadConfig;
+    if (c.enterLatenessMs && (!c.exitLatenessMs || c.exitLatenessMs > c.enterLatenessMs)) {
+        if (c.exitLatenessMs) gLogger->println("Overload: exitLatenessMs above enterLatenessMs, using 3/4 of enter");
+        c.exitLatenessMs = (uint32_t)((uint64_t)c.enterLatenessMs * 3 / 4);
+    }
+    if (c.enterUtilPermille && (!c.exitUtilPermille || c.exitUtilPermille > c.enterUtilPermille)) {
+        if (c.exitUtilPermille) gLogger->println("Overload: exitUtilPermille above enterUtilPermille, using 3/4 of enter");
+        c.exitUtilPermille = c.enterUtilPermille * 3 / 4;
+    }
+    onOverloadChange = onChange;
+    overloadEnabled = true;
+    windowStartUs = clockUs();
+    windowBusyUs = 0;
+    windowMaxLatenessMs = 0;
+}
+
+void Scheduler::disableOverloadManagement() {
+    MuxGuard lock(&schedMux);
+    overloadEnabled = false;
+    overloaded = false;
+}
+
+void Scheduler::setAdmissionControl(const AdmissionConfig& config) {
+    MuxGuard lock(&schedMux);
+    admissionConfig = config;
+    admissionEnabled = true;
+    for (Task& t : tasks) updateLoad(t); // defaultCostUs may have changed
+}
+
+void Scheduler::disableAdmissionControl() {
+    MuxGuard lock(&schedMux);
+    admissionEnabled = false;
+}
+
+// cost of a repeating task: measured once it ran, else declared, else the default
+uint32_t Scheduler::taskCostUs(const Task& t) const {
+    if (t.runs && t.worstExecUs) return t.worstExecUs;
+    return t.costUs ? t.costUs : admissionConfig.defaultCostUs;
+}
+
+// moves t's share of repeatingLoadPpm to its current cost and interval
+void Scheduler::updateLoad(Task& t) {
+    uint64_t ppm = 0;
+    if (t.repeat) ppm = (uint64_t)taskCostUs(t) * 1000 / (t.interval ? t.interval : 1);
+    if (ppm > UINT32_MAX) ppm = UINT32_MAX;
+    repeatingLoadPpm = repeatingLoadPpm - t.loadPpm + ppm;
+    t.loadPpm = (uint32_t)ppm;
+}
+
+// sum of cost / interval over the repeating tasks but exclude, in parts per million, O(1)
+// (a lookup of exclude)
+uint32_t Scheduler::projectedLoadPpm(PID_t exclude) const {
+    uint64_t ppm = repeatingLoadPpm;
+    const Task* t = exclude ? findTask(exclude) : nullptr;
+    if (t) ppm -= t->loadPpm;
+    return ppm > UINT32_MAX ? UINT32_MAX : (uint32_t)ppm;
+}
+
+uint16_t Scheduler::projectedUtilPermille() const {
+    MuxGuard lock(&schedMux);
+    const uint32_t permille = projectedLoadPpm(0) / 1000;
+    return permille > 0xFFFF ? 0xFFFF : permille;
+}
+
+Scheduler::AddStatus Scheduler::admit(Task& t) const {
+    const uint64_t cost = taskCostUs(t);
+    if (!cost) return ADD_OK; // nothing known about it
+    const uint64_t budgetPpm = (uint64_t)admissionConfig.budgetPermille * 1000;
+    const uint64_t loadPpm = projectedLoadPpm(t.PID); // t itself counts with its new interval
+    const uint32_t interval = t.interval ? t.interval : 1;
+    if (loadPpm + cost * 1000 / interval <= budgetPpm) return ADD_OK;
+    if (!admissionConfig.degrade || loadPpm >= budgetPpm) return ADD_REJECTED_LOAD;
+
+    // the shortest interval that keeps the projection within the budget
+    const uint64_t avail = budgetPpm - loadPpm;
+    const uint64_t stretched = (cost * 1000 + avail - 1) / avail;
+    if (stretched > UINT32_MAX ||
+        (admissionConfig.maxIntervalMs && stretched > admissionConfig.maxIntervalMs)) {
+        return ADD_REJECTED_LOAD;
+    }
+    t.interval = (uint32_t)stretched;
+    return ADD_DEGRADED;
+}
+
+Scheduler::OverloadStatus Scheduler::overloadStatus() const {
+    MuxGuard lock(&schedMux);
+    OverloadStatus st;
+    st.overloaded = overloaded;
+    st.latenessMs = latenessAvg16 >> 4;
+    st.utilPermille = utilAvg16 >> 4;
+    st.shedRuns = shedRuns;
+    return st;
+}
+
+// moving average with weight 1/8, values kept in 1/16 units
+static void updateAverage16(uint32_t& avg16, uint32_t sample) {
+    const int32_t diff = (int32_t)(sample << 4) - (int32_t)avg16;
+    avg16 += diff / 8;
+}
+
+void Scheduler::endOfLoop(unsigned long startUs) {
+    const unsigned long endUs = clockUs();
+    std::function<void(bool)> notify;
+    bool state = false;
+    {
+        MuxGuard lock(&schedMux);
+        // passes that only armed or scanned tasks are idle time, else calling loop()
+        // continuously would look like load
+        const uint32_t busyUs = loopDidWork ? (uint32_t)(endUs - startUs) - loopBackgroundUs : 0;
+        counters.busyUs += busyUs;
+        counters.backgroundUs += loopBackgroundUs;
+        if (loopMaxLatenessMs > counters.maxLatenessMs) counters.maxLatenessMs = loopMaxLatenessMs;
+        if (loopDidWork) {
+            counters.workCalls++;
+            if (!lastLoopDidWork) counters.wakeups++;
+        }
+        lastLoopDidWork = loopDidWork;
+        if (!overloadEnabled) return;
+
+        windowBusyUs += busyUs;
+        if (loopMaxLatenessMs > windowMaxLatenessMs) windowMaxLatenessMs = loopMaxLatenessMs;
+        const uint32_t elapsedUs = endUs - windowStartUs;
+        if (elapsedUs < overloadConfig.windowMs * 1000UL) return;
+
+        // window complete => one sample each
+        const uint32_t util = windowBusyUs >= elapsedUs ? 1000 : (uint32_t)((uint64_t)windowBusyUs * 1000 / elapsedUs);
+        updateAverage16(utilAvg16, util);
+        updateAverage16(latenessAvg16, windowMaxLatenessMs > 0x0FFFFFFF ? 0x0FFFFFFF : windowMaxLatenessMs);
+        windowStartUs = endUs;
+        windowBusyUs = 0;
+        windowMaxLatenessMs = 0;
+
+        const OverloadConfig& c = overloadConfig;
+        const uint32_t lateness = latenessAvg16 >> 4;
+        const uint32_t avgUtil = utilAvg16 >> 4;
+        if (!overloaded) {
+            overloaded = (c.enterLatenessMs && lateness >= c.enterLatenessMs) ||
+                         (c.enterUtilPermille && avgUtil >= c.enterUtilPermille);
+            if (overloaded) notify = onOverloadChange;
+        }
+        else if ((!c.enterLatenessMs || lateness <= c.exitLatenessMs) &&
+                 (!c.enterUtilPermille || avgUtil <= c.exitUtilPermille)) {
+            overloaded = false;
+            notify = onOverloadChange;
+        }
+        state = overloaded;
+    }
+    if (notify) notify(state);
+}
+
+Scheduler::Metrics Scheduler::metrics() const {
+    MuxGuard lock(&schedMux);
+    Metrics m;
+    m.elapsedMs = clockMs() - counters.startMs;
+    m.loopCalls = counters.loopCalls;
+    m.workCalls = counters.workCalls;
+    m.wakeups = counters.wakeups;
+    m.dispatched = counters.dispatched;
+    m.conditionEvals = counters.conditionEvals;
+    m.timeouts = counters.timeouts;
+    m.busyUs = counters.busyUs;
+    m.backgroundUs = counters.backgroundUs;
+    m.maxLatenessMs = counters.maxLatenessMs;
+    const uint64_t elapsedUs = (uint64_t)m.elapsedMs * 1000;
+    m.idleUs = elapsedUs > m.busyUs ? elapsedUs - m.busyUs : 0; // includes backgroundUs
+
+    const float secs = m.elapsedMs ? m.elapsedMs / 1000.0f : 1.0f;
+    m.loopCallsPerSec = m.loopCalls / secs;
+    m.workFraction = m.loopCalls ? (float)m.workCalls / m.loopCalls : 0.0f;
+    m.busyFraction = elapsedUs ? (float)m.busyUs / elapsedUs : 0.0f;
+    m.dispatchedPerSec = m.dispatched / secs;
+    m.conditionEvalsPerSec = m.conditionEvals / secs;
+    m.timeoutsPerSec = m.timeouts / secs;
+    m.wakeupsPerHour = m.wakeups * 3600.0f / secs;
+    return m;
+}
+
+void Scheduler::resetMetrics() {
+    MuxGuard lock(&schedMux);
+    counters = MetricCounters();
+    counters.startMs = clockMs();
+}
+
+void Scheduler::setStarvationMonitor(uint32_t thresholdMs, std::function<void(uint32_t)> onStarved) {
+    MuxGuard lock(&schedMux);
+    starvationThresholdUs = thresholdMs * 1000UL;
+    onStarvation = onStarved;
+}
+
+Scheduler::LoopGapStats Scheduler::loopGapStats() const {
+    MuxGuard lock(&schedMux);
+    return gapStats;
+}
+
+void Scheduler::resetLoopGapStats() {
+    MuxGuard lock(&schedMux);
+    const uint32_t calls = gapStats.calls;
+    gapStats = LoopGapStats();
+    gapStats.calls = calls; // keeps the first-call detection intact
+}
+
+// called first thing in loop(), also when there is nothing to do
+void Scheduler::recordLoopGap() {
+    const unsigned long nowUs = clockUs();
+    std::function<void(uint32_t)> notify;
+    uint32_t gapUs;
+    {
+        MuxGuard lock(&schedMux);
+        counters.loopCalls++;
+        gapUs = nowUs - lastLoopCallUs;
+        lastLoopCallUs = nowUs;
+        if (!gapStats.calls++) return; // no gap yet
+
+        gapStats.lastGapUs = gapUs;
+        if (gapUs > gapStats.maxGapUs) gapStats.maxGapUs = gapUs;
+        uint8_t bucket = 0;
+        for (uint32_t ms = gapUs / 1000; ms && bucket + 1 < SCHEDULER_LOOP_GAP_BUCKETS; ms >>= 1) bucket++;
+        gapStats.histogram[bucket]++;
+        if (starvationThresholdUs && gapUs > starvationThresholdUs) {
+            gapStats.starved++;
+            notify = onStarvation;
+        }
+    }
+    if (notify) notify(gapUs / 1000);
+}
+
+#if SCHEDULER_WATCHDOG
+void Scheduler::enableWatchdog(uint32_t defaultBudgetUs, void (*hook)(const SchedulerCrashRecord&)) {
+    watchdogDefaultBudgetUs = defaultBudgetUs;
+    watchdogHook = hook;
+    wdStage = STAGE_NONE;
+    watchdogEnabled = true;
+}
+
+bool IRAM_ATTR Scheduler::checkWatchdog() {
+    const uint8_t stage = wdStage;
+    if (stage == STAGE_NONE || wdTripped) return false;
+    const uint32_t budget = wdBudgetUs;
+    const uint32_t elapsed = micros() - wdStartUs;
+    if (!budget || elapsed <= budget || stage != wdStage) return false;
+
+    wdTripped = true; // once per callback
+    watchdogTrips = watchdogTrips + 1;
+    if (crashRecord.magic != CRASH_RECORD_MAGIC) {
+        crashRecord.magic = CRASH_RECORD_MAGIC;
+        crashRecord.count = 0;
+    }
+    crashRecord.count++;
+    crashRecord.PID = wdPID;
+    crashRecord.stage = stage;
+    crashRecord.elapsedUs = elapsed;
+    crashRecord.budgetUs = budget;
+    if (watchdogHook) watchdogHook(crashRecord);
+    return true;
+}
+
+bool Scheduler::lastCrashRecord(SchedulerCrashRecord& out) {
+    if (crashRecord.magic != CRASH_RECORD_MAGIC) return false;
+    out = crashRecord;
+    return true;
+}
+
+void Scheduler::clearCrashRecord() {
+    crashRecord.magic = 0;
+    crashRecord.count = 0;
+}
+#endif
+
+#if SCHEDULER_SEQUENTIAL
 void Scheduler::setAndStartSequentialMode(bool seq) {
     sequentialMode = seq;
     if (sequentialMode) {
-        lastSequentialFinishTime = millis();
+        lastSequentialFinishTime = clockMs();
     }
 }
+#endif
 
 /* 
    1) addTimedTask:
@@ -67,14 +424,17 @@ void Scheduler::setAndStartSequentialMode(bool seq) {
 PID_t Scheduler::addTimedTask(std::function<void()> onExecute,
                              uint32_t delayMs,
                              bool repeat,
-                             uint32_t interval)
+                             uint32_t interval,
+                             uint32_t costUs,
+                             AddStatus* status)
 {
     if (sequentialMode && repeat) {
         gLogger->println("Warning: Repeat tasks are not supported in sequential mode. Disabling repeat.");
         repeat = false;
     }
-    if (taskCount() >= MAX_TASKS){
-        gLogger->println("Too many tasks, only 124 allowed not adding more");
+    if (taskCount() >= SCHEDULER_MAX_TASKS){
+        gLogger->println("Too many tasks, SCHEDULER_MAX_TASKS reached, not adding more");
+        if (status) *status = ADD_REJECTED_FULL;
         return 0;
     }
     if(repeat && interval == 0) {
@@ -89,6 +449,7 @@ PID_t Scheduler::addTimedTask(std::function<void()> onExecute,
     // Condition => "always true"
     t.condition = [](){ return true; };
     t.conditionMet = false;
+    t.timed = true;
     
     // We do not wait for condition => conditionWait=0 => immediate
     t.conditionWait = 0;  
@@ -99,12 +460,25 @@ PID_t Scheduler::addTimedTask(std::function<void()> onExecute,
     // We'll set "executeAt" dynamically
     t.executeAt = 0;
 
+    t.costUs = costUs;
+
     t.PID = getAndIncrementPID();
 
+    // admission and insertion under one lock, so a burst of adds sees every admitted task
+    AddStatus admission = ADD_OK;
     taskENTER_CRITICAL(&schedMux);
-    tasks.push_back(t);
+    if (repeat && admissionEnabled) admission = admit(t);
+    if (admission != ADD_REJECTED_LOAD) insertTask(t);
     taskEXIT_CRITICAL(&schedMux);
 
+    if (status) *status = admission;
+    if (admission == ADD_REJECTED_LOAD) {
+        gLogger->println("Admission control: repeating task over the utilization budget, not adding");
+        return 0;
+    }
+    // the admitted interval, a replay needs no admission config
+    tapSubmitted(SchedulerTap::SUBMIT_TIMED, t.PID, delayMs, repeat, t.interval);
+    wake();
     return t.PID;
 }
 
@@ -114,8 +488,8 @@ PID_t Scheduler::addConditionalTask(std::function<void()> onExecute,
                                    uint32_t conditionWaitMs,
                                    std::function<void(PID_t)> onTimeout)
 {
-    if (taskCount() >= MAX_TASKS){
-        gLogger->println("Too many tasks, only 124 allowed not adding more");
+    if (taskCount() >= SCHEDULER_MAX_TASKS){
+        gLogger->println("Too many tasks, SCHEDULER_MAX_TASKS reached, not adding more");
         return 0;
     }
     Task t;
@@ -123,18 +497,25 @@ PID_t Scheduler::addConditionalTask(std::function<void()> onExecute,
     t.onTimeout = onTimeout;
     t.repeat = false;
     t.interval = 0;
+    if (!condition) {
+        gLogger->println("ERROR: Task has no condition!");
+        condition = [](){ return true; }; // treated as trivially true, checked once here instead of in loop()
+    }
     t.condition = condition;
     t.conditionMet = false;
     t.conditionWait = conditionWaitMs;  // can be <= 0 => indefinite
     t.postConditionDelay = 0;           // no additional delay
     t.executeAt = 0;
+    t.lastConditionCheck = clockMs();
 
     t.PID = getAndIncrementPID();
 
     taskENTER_CRITICAL(&schedMux);
-    tasks.push_back(t);
+    insertTask(t);
     taskEXIT_CRITICAL(&schedMux);
 
+    tapSubmitted(SchedulerTap::SUBMIT_CONDITIONAL, t.PID, conditionWaitMs, 0, onTimeout ? 1 : 0);
+    wake();
     return t.PID;
 }
 
@@ -145,8 +526,8 @@ PID_t Scheduler::addConditionalTimedTask(std::function<void()> onExecute,
                                         uint32_t conditionWaitMs,
                                         std::function<void(PID_t)> onTimeout)
 {
-    if (taskCount() >= MAX_TASKS){
-        gLogger->println("Too many tasks, only 124 allowed not adding more");
+    if (taskCount() >= SCHEDULER_MAX_TASKS){
+        gLogger->println("Too many tasks, SCHEDULER_MAX_TASKS reached, not adding more");
         return 0;
     }
     Task t;
@@ -154,76 +535,789 @@ PID_t Scheduler::addConditionalTimedTask(std::function<void()> onExecute,
     t.onTimeout = onTimeout;
     t.repeat = false;
     t.interval = 0;
+    if (!condition) {
+        gLogger->println("ERROR: Task has no condition!");
+        condition = [](){ return true; }; // treated as trivially true, checked once here instead of in loop()
+    }
     t.condition = condition;
     t.conditionMet = false;
     t.conditionWait = conditionWaitMs;
     t.postConditionDelay = postDelayMs;
     t.executeAt = 0;
+    t.lastConditionCheck = clockMs();
 
     t.PID = getAndIncrementPID();
     taskENTER_CRITICAL(&schedMux);
-    tasks.push_back(t);
+    insertTask(t);
     taskEXIT_CRITICAL(&schedMux);
     
+    tapSubmitted(SchedulerTap::SUBMIT_CONDITIONAL, t.PID, conditionWaitMs, postDelayMs, onTimeout ? 1 : 0);
+    wake();
+    return t.PID;
+
+}
+
+// 4) addSignalledTask => dormant until signalTask(), no condition to poll
+PID_t Scheduler::addSignalledTask(std::function<void()> onExecute, bool persistent,
+                                  uint32_t timeoutMs, std::function<void(PID_t)> onTimeout)
+{
+    if (sequentialMode) {
+        gLogger->println("Warning: Signalled tasks are not supported in sequential mode. Not adding.");
+        return 0;
+    }
+    if (persistent && timeoutMs) {
+        gLogger->println("Warning: Persistent signalled tasks have no timeout. Ignoring it.");
+        timeoutMs = 0;
+    }
+    if (taskCount() >= SCHEDULER_MAX_TASKS){
+        gLogger->println("Too many tasks, SCHEDULER_MAX_TASKS reached, not adding more");
+        return 0;
+    }
+    Task t;
+    t.onExecute = onExecute;
+    t.repeat = false;
+    t.interval = 0;
+    t.condition = [](){ return false; }; // never evaluated, signalTask() sets conditionMet
+    t.conditionMet = false;
+    t.signalled = true;
+    t.persistent = persistent;
+    t.onTimeout = onTimeout;
+    t.conditionWait = timeoutMs;
+    t.postConditionDelay = 0;
+    t.executeAt = 0;
+
+    t.PID = getAndIncrementPID();
+    taskENTER_CRITICAL(&schedMux);
+    if (timeoutMs) {
+        // expires through the timeout index like a condition deadline
+        t.setConditionDeadline(clockMs() + timeoutMs);
+        timeoutHeap.push_back({t.conditionDeadline, t.PID});
+        std::push_heap(timeoutHeap.begin(), timeoutHeap.end(), TimeoutEntry::later);
+    }
+    insertTask(t);
+    taskEXIT_CRITICAL(&schedMux);
+
+    tapSubmitted(SchedulerTap::SUBMIT_SIGNALLED, t.PID, persistent, timeoutMs, onTimeout ? 1 : 0);
+    wake();
+    return t.PID;
+}
+
+// 6) addChildScheduler => a persistent task that runs child.loop() when the child has work
+PID_t Scheduler::addChildScheduler(Scheduler& child)
+{
+    if (&child == this || child.hasDescendant(this)) {
+        gLogger->println("Child scheduler would form a cycle, not adding");
+        return 0;
+    }
+    if (sequentialMode) {
+        gLogger->println("Warning: Child schedulers are not supported in sequential mode. Not adding.");
+        return 0;
+    }
+    if (taskCount() >= SCHEDULER_MAX_TASKS){
+        gLogger->println("Too many tasks, SCHEDULER_MAX_TASKS reached, not adding more");
+        return 0;
+    }
+    Task t;
+    Scheduler* c = &child;
+    t.onExecute = [c]() { c->loop(); };
+    t.repeat = false;
+    t.interval = 0;
+    t.condition = [](){ return false; }; // never evaluated, the child's deadline decides
+    t.conditionMet = false;
+    t.child = c;
+    t.conditionWait = 0;
+    t.postConditionDelay = 0;
+    t.executeAt = 0;
+
+    t.PID = getAndIncrementPID();
+    taskENTER_CRITICAL(&schedMux);
+    insertTask(t);
+    taskEXIT_CRITICAL(&schedMux);
+
+    wake();
     return t.PID;
+}
 
+// true if s is a child of this scheduler, or of one of its children
+bool Scheduler::hasDescendant(const Scheduler* s) const
+{
+    std::vector<Scheduler*> kids;
+    {
+        MuxGuard lock(&schedMux);
+        for (const Task& t : tasks) {
+            if (t.child) kids.push_back(t.child);
+        }
+    }
+    for (Scheduler* c : kids) {
+        if (c == s || c->hasDescendant(s)) return true;
+    }
+    return false;
+}
+
+// 7) addBackgroundTask => a dormant signalled task as placeholder, the chunk runs from runBackground()
+PID_t Scheduler::addBackgroundTask(std::function<bool(BackgroundSlice&)> chunk)
+{
+    if (sequentialMode) {
+        gLogger->println("Warning: Background tasks are not supported in sequential mode. Not adding.");
+        return 0;
+    }
+    if (!chunk) {
+        gLogger->println("ERROR: Background task has no chunk!");
+        return 0;
+    }
+    if (taskCount() >= SCHEDULER_MAX_TASKS){
+        gLogger->println("Too many tasks, SCHEDULER_MAX_TASKS reached, not adding more");
+        return 0;
+    }
+    Task t;
+    t.repeat = false;
+    t.interval = 0;
+    t.condition = [](){ return false; }; // never evaluated, never armed
+    t.conditionMet = false;
+    t.signalled = true;
+    t.persistent = true;
+    t.background = true;
+    t.conditionWait = 0;
+    t.postConditionDelay = 0;
+    t.executeAt = 0;
+
+    t.PID = getAndIncrementPID();
+    taskENTER_CRITICAL(&schedMux);
+    insertTask(t);
+    background.push_back({t.PID, chunk});
+    taskEXIT_CRITICAL(&schedMux);
+    tapSubmitted(SchedulerTap::SUBMIT_BACKGROUND, t.PID);
+
+    wake(); // spare time may be there already
+    return t.PID;
+}
+
+// 8) addRetryTask => a persistent signalled task that re-arms itself after a failed attempt
+PID_t Scheduler::addRetryTask(std::function<bool()> attempt, const RetryPolicy& policy,
+                              std::function<void(PID_t)> onFailure, uint32_t delayMs)
+{
+    if (!attempt) {
+        gLogger->println("ERROR: Retry task has no attempt!");
+        return 0;
+    }
+    const PID_t pid = addSignalledTask(nullptr, true);
+    if (!pid) return 0;
+    {
+        MuxGuard lock(&schedMux);
+        Task* t = findTask(pid);
+        if (!t) return 0; // stop() meanwhile
+        t->onTimeout = onFailure; // final failure, called like a timeout
+        t->onExecute = [this, pid, attempt, policy]() { retryAttempt(pid, attempt, policy); };
+    }
+    signalTask(pid, delayMs);
+    return pid;
+}
+
+void Scheduler::retryAttempt(PID_t pid, const std::function<bool()>& attempt, const RetryPolicy& policy) {
+    if (attempt()) {
+        removeTask(pid);
+        return;
+    }
+    uint32_t delay = 0;
+    bool exhausted = false;
+    std::function<void(PID_t)> onFailure;
+    {
+        MuxGuard lock(&schedMux);
+        const Task* t = findTask(pid);
+        if (!t) return;
+        const uint32_t failed = t->runs + 1; // runs counts the earlier attempts
+        if (policy.maxAttempts && failed >= policy.maxAttempts) {
+            exhausted = true;
+            onFailure = t->onTimeout;
+        } else {
+            // backoff, capped, then the jitter. Deadlines compare as int32_t, a longer
+            // delay would be in the past
+            const uint64_t cap = policy.maxDelayMs && policy.maxDelayMs < INT32_MAX ? policy.maxDelayMs : INT32_MAX;
+            uint64_t d = policy.initialDelayMs;
+            for (uint32_t i = 1; i < failed && d < cap; i++) d = d * policy.multiplierPercent / 100;
+            if (d > cap) d = cap;
+            const uint64_t spread = d * (policy.jitterPercent > 100 ? 100 : policy.jitterPercent) / 100;
+            if (spread) {
+                if (!jitterState) jitterState = clockUs() | 1;
+                jitterState ^= jitterState << 13;
+                jitterState ^= jitterState >> 17;
+                jitterState ^= jitterState << 5;
+                d = d - spread + jitterState % (2 * spread + 1);
+            }
+            delay = d > INT32_MAX ? INT32_MAX : (uint32_t)d;
+        }
+    }
+    if (exhausted) {
+        removeTask(pid);
+        if (onFailure) onFailure(pid);
+        return;
+    }
+    signalTask(pid, delay);
+}
+
+bool Scheduler::backgroundReady() const {
+    {
+        MuxGuard lock(&schedMux);
+        if (background.empty() || onHold) return false;
+    }
+    return timeToNextTask() > backgroundSlackMs;
+}
+
+void Scheduler::runBackground() {
+    {
+        MuxGuard lock(&schedMux);
+        if (background.empty() || will_stop) return;
+    }
+    const uint32_t next = timeToNextTask();
+    if (next <= backgroundSlackMs) return;
+    uint32_t sliceMs = next - backgroundSlackMs;
+    if (backgroundMaxSliceMs && sliceMs > backgroundMaxSliceMs) sliceMs = backgroundMaxSliceMs;
+    const unsigned long startUs = clockUs();
+    BackgroundSlice slice(*this, startUs + sliceMs * 1000UL);
+
+    // round-robin, one chunk call per entry and turn, until the slice is used up
+    while (!slice.shouldYield()) {
+        PID_t pid = 0;
+        uint32_t budgetUs = 0;
+        std::function<bool(BackgroundSlice&)> chunk; // a copy, chunks may add background tasks
+        {
+            MuxGuard lock(&schedMux);
+            while (!background.empty()) {
+                if (backgroundCursor >= background.size()) backgroundCursor = 0;
+                const PID_t p = background[backgroundCursor].PID;
+                const Task* t = findTask(p);
+                if (t && std::find(tasksToRemove.begin(), tasksToRemove.end(), p) == tasksToRemove.end()) {
+                    pid = p;
+                    budgetUs = t->budgetUs;
+                    chunk = background[backgroundCursor].chunk;
+                    backgroundCursor++;
+                    break;
+                }
+                background.erase(background.begin() + backgroundCursor); // removed
+            }
+        }
+        if (!pid) break; // none left
+
+        const unsigned long execStart = clockUs();
+        stageBegin(pid, STAGE_BACKGROUND, budgetUs);
+        const bool more = chunkOutcome(pid, [&chunk, &slice]() { return chunk(slice); }); // recorded like a condition
+        const bool overBudget = stageEnd();
+        const uint32_t execUs = clockUs() - execStart;
+
+        MuxGuard lock(&schedMux);
+        Task* t = findTask(pid);
+        if (!t) continue;
+        t->runs++;
+        if (execUs > t->worstExecUs) t->worstExecUs = execUs;
+        if (overBudget) t->overruns++;
+        if (!more) eraseTask(pid); // the foreground pass is over, its entry goes next turn
+    }
+    loopBackgroundUs += clockUs() - startUs;
+}
+
+bool Scheduler::signalTask(PID_t pid, uint32_t delayMs){
+    {
+        MuxGuard lock(&schedMux);
+        Task* t = getTaskByPID(pid);
+        if (!t || !t->signalled || t->background) return false;
+        const uint32_t now = clockMs();
+        t->conditionMet = true;
+        t->conditionDeadline = 0; // a pending timeout is off
+        t->setExecutionTime(now + delayMs);
+        armed(*t, now);
+        tapSubmitted(SchedulerTap::SUBMIT_SIGNAL, pid, delayMs);
+    }
+    wake();
+    return true;
+}
+
+bool Scheduler::disarmTask(PID_t pid){
+    MuxGuard lock(&schedMux);
+    Task* t = getTaskByPID(pid);
+    if (!t || !t->signalled || t->background) return false;
+    t->conditionMet = false;
+    tapSubmitted(SchedulerTap::SUBMIT_DISARM, pid);
+    return true;
+}
+
+bool Scheduler::allocFutureSlot(uint8_t& slot, uint16_t& generation){
+    MuxGuard lock(&schedMux);
+    for (uint8_t i = 0; i < SCHEDULER_FUTURE_SLOTS; i++) {
+        FutureSlot& fs = futureSlots[i];
+        if (fs.used) continue;
+        fs.used = true;
+        fs.ready = false;
+        fs.destroy = nullptr;
+        fs.continuation = 0;
+        fs.stopped = false;
+        slot = i;
+        generation = fs.generation;
+        return true;
+    }
+    gLogger->println("No free future slot, raise SCHEDULER_FUTURE_SLOTS");
+    return false;
+}
+
+void Scheduler::releaseFutureSlot(uint8_t slot, uint16_t generation){
+    PID_t orphan = 0;
+    {
+        MuxGuard lock(&schedMux);
+        FutureSlot& fs = futureSlots[slot];
+        if (!fs.used || fs.generation != generation) return;
+        if (fs.destroy) fs.destroy(fs.storage);
+        // a continuation that was never armed would wait forever
+        if (!fs.ready) orphan = fs.continuation;
+        fs.destroy = nullptr;
+        fs.ready = false;
+        fs.used = false;
+        fs.continuation = 0;
+        fs.stopped = false;
+        fs.generation++;
+    }
+    if (orphan) removeTask(orphan);
+}
+
+// caller must own schedMux; outstanding handles read as not ready afterwards
+void Scheduler::resetFutureSlots(bool stoppedOnly){
+    for (FutureSlot& fs : futureSlots) {
+        if (!fs.used || (stoppedOnly && !fs.stopped)) continue;
+        if (fs.destroy) fs.destroy(fs.storage);
+        fs.destroy = nullptr;
+        fs.ready = false;
+        fs.used = false;
+        fs.continuation = 0;
+        fs.stopped = false;
+        fs.generation++;
+    }
+    if (stoppedOnly) futureResetPending = false;
+}
+
+bool Scheduler::futureReady(uint8_t slot, uint16_t generation) const {
+    MuxGuard lock(&schedMux);
+    const FutureSlot& fs = futureSlots[slot];
+    return fs.used && fs.ready && fs.generation == generation;
+}
+
+void* Scheduler::futureValue(uint8_t slot, uint16_t generation){
+    MuxGuard lock(&schedMux);
+    FutureSlot& fs = futureSlots[slot];
+    if (!fs.used || !fs.ready || fs.generation != generation) return nullptr;
+    return fs.storage;
+}
+
+bool Scheduler::setFutureContinuation(uint8_t slot, uint16_t generation, PID_t pid){
+    bool armNow;
+    {
+        MuxGuard lock(&schedMux);
+        FutureSlot& fs = futureSlots[slot];
+        if (!fs.used || fs.generation != generation || fs.continuation) return false;
+        fs.continuation = pid;
+        armNow = fs.ready;
+    }
+    if (armNow) signalTask(pid);
+    return true;
 }
 
 bool Scheduler::removeTask(PID_t pid){
     MuxGuard lock(&schedMux); 
-    auto it = std::find_if(tasks.begin(), tasks.end(), [pid](const Task &t) { return t.PID == pid; });
-    if (it == tasks.end()) return false;  
+    if (!findTask(pid)) return false;  
     tasksToRemove.push_back(pid);//just schedule for removal, don't remove immediately
+    tapSubmitted(SchedulerTap::SUBMIT_REMOVE, pid);
+    return true;
+}
+
+bool Scheduler::bindRateLimiter(PID_t pid, TokenBucket* bucket){
+    if (sequentialMode) {
+        gLogger->println("Warning: Rate limiters are not supported in sequential mode. Not binding.");
+        return false;
+    }
+    MuxGuard lock(&schedMux);
+    Task* t = getTaskByPID(pid);
+    if (!t) return false;
+    t->bucket = bucket;
+    return true;
+}
+
+#if SCHEDULER_WATCHDOG
+bool Scheduler::setTaskBudget(PID_t pid, uint32_t budgetUs){
+    MuxGuard lock(&schedMux);
+    Task* t = getTaskByPID(pid);
+    if (!t) return false;
+    t->budgetUs = budgetUs;
+    return true;
+}
+#endif
+
+bool Scheduler::setTaskPriority(PID_t pid, uint8_t priority){
+    MuxGuard lock(&schedMux);
+    Task* t = getTaskByPID(pid);
+    if (!t) return false;
+    t->priority = priority;
+    tapSubmitted(SchedulerTap::SUBMIT_PRIORITY, pid, priority);
+    return true;
+}
+
+size_t Scheduler::collectPeriodicTasks(std::vector<AnalysisTask>& out) const {
+    MuxGuard lock(&schedMux);
+    size_t n = 0;
+    for (const Task& t : tasks) {
+        if (!t.repeat) continue;
+        out.push_back(AnalysisTask{t.PID, t.interval, t.worstExecUs});
+        n++;
+    }
+    return n;
+}
+
+static bool deadlineEarlier(const Scheduler::UpcomingDeadline& a, const Scheduler::UpcomingDeadline& b) {
+    return a.inMs < b.inMs;
+}
+
+#if SCHEDULER_INDEXED
+// visits the entries of a binary min-heap in order without changing it, through a
+// frontier heap of positions, until visit() accepted n of them. O(n log n) plus the
+// entries visit() rejects (stale) on the way.
+template<typename E, typename Later, typename Visit>
+static void walkHeapInOrder(const std::vector<E>& heap, size_t n, Later later, Visit visit) {
+    auto posLater = [&](size_t a, size_t b) { return later(heap[a], heap[b]); };
+    std::vector<size_t> frontier;
+    if (heap.empty()) return;
+    frontier.reserve(2 * n + 2);
+    frontier.push_back(0);
+    size_t accepted = 0;
+    while (!frontier.empty() && accepted < n) {
+        std::pop_heap(frontier.begin(), frontier.end(), posLater);
+        const size_t i = frontier.back();
+        frontier.pop_back();
+        for (size_t c = 2 * i + 1; c <= 2 * i + 2 && c < heap.size(); c++) {
+            frontier.push_back(c);
+            std::push_heap(frontier.begin(), frontier.end(), posLater);
+        }
+        if (visit(heap[i])) accepted++;
+    }
+}
+#endif
+
+size_t Scheduler::upcomingDeadlines(UpcomingDeadline* out, size_t n, size_t tasksPerLock) const {
+    if (!out || !n) return 0;
+    if (!tasksPerLock) tasksPerLock = 1;
+    const uint32_t now = clockMs();
+    size_t filled = 0; // out[0..filled) is a max-heap on inMs while collecting
+
+    // keeps the n earliest
+    auto offer = [&](PID_t pid, uint32_t deadline, uint8_t stage) {
+        UpcomingDeadline d;
+        d.PID = pid;
+        d.deadline = deadline;
+        d.inMs = (int32_t)(deadline - now);
+        d.stage = stage;
+        if (filled < n) {
+            out[filled++] = d;
+            std::push_heap(out, out + filled, deadlineEarlier);
+        } else if (d.inMs < out[0].inMs) {
+            std::pop_heap(out, out + filled, deadlineEarlier);
+            out[filled - 1] = d;
+            std::push_heap(out, out + filled, deadlineEarlier);
+        }
+    };
+
+#if SCHEDULER_INDEXED
+    // the heaps already order the armed deadlines, so only their earliest entries, the
+    // tasks still to arm and the children are visited, all under one lock
+    std::vector<std::pair<PID_t, Scheduler*>> kids; // asked outside our lock
+    {
+        MuxGuard lock(&schedMux);
+        walkHeapInOrder(execHeap, n, ExecEntry::later, [&](const ExecEntry& e) {
+            if (!isLive(e)) return false;
+            const Task* t = findTask(e.PID);
+            uint32_t at = e.at;
+            if (t->bucket) {
+                const uint32_t tokenAt = now + t->bucket->msUntilToken(now);
+                if ((int32_t)(tokenAt - at) > 0) at = tokenAt;
+            }
+            offer(e.PID, at, STAGE_EXECUTE);
+            return true;
+        });
+        walkHeapInOrder(timeoutHeap, n, TimeoutEntry::later, [&](const TimeoutEntry& e) {
+            const Task* t = findTask(e.PID);
+            if (!t || t->conditionMet || t->conditionDeadline != e.deadline) return false;
+            offer(e.PID, e.deadline, STAGE_TIMEOUT);
+            return true;
+        });
+        for (PID_t pid : toArm) {
+            const Task* t = findTask(pid);
+            if (!t || t->conditionMet) continue;
+            if (t->timed) offer(pid, now + t->postConditionDelay, STAGE_EXECUTE); // armed by the next loop()
+            else if (!t->conditionDeadline && !t->indefinite()) offer(pid, now + t->conditionWait, STAGE_TIMEOUT);
+        }
+        for (PID_t pid : children) {
+            const Task* t = findTask(pid);
+            if (t && t->child) kids.push_back(std::make_pair(pid, t->child));
+        }
+    }
+    for (const auto& c : kids) {
+        UpcomingDeadline d;
+        if (c.second->upcomingDeadlines(&d, 1, tasksPerLock)) offer(c.first, now + d.inMs, STAGE_EXECUTE);
+    }
+#else
+    for (size_t i = 0; ; ) {
+        // children are queried outside our lock, they have their own
+        Scheduler* children[4];
+        PID_t childPIDs[4];
+        size_t nChildren = 0;
+        bool end = false;
+        {
+            MuxGuard lock(&schedMux);
+            const size_t stop = i + tasksPerLock;
+            for (; i < stop && i < tasks.size(); i++) {
+                const Task& t = tasks[i];
+                if (t.child) {
+                    if (nChildren == 4) break; // rest in the next chunk
+                    children[nChildren] = t.child;
+                    childPIDs[nChildren++] = t.PID;
+                    continue;
+                }
+                if (t.conditionMet) {
+                    uint32_t at = t.executeAt;
+                    if (t.bucket) {
+                        const uint32_t tokenAt = now + t.bucket->msUntilToken(now);
+                        if ((int32_t)(tokenAt - at) > 0) at = tokenAt;
+                    }
+                    offer(t.PID, at, STAGE_EXECUTE);
+                }
+                else if (t.signalled) {
+                    if (t.conditionDeadline) offer(t.PID, t.conditionDeadline, STAGE_TIMEOUT);
+                    continue; // dormant
+                }
+                else if (t.timed) {
+                    offer(t.PID, now + t.postConditionDelay, STAGE_EXECUTE); // armed by the next loop()
+                }
+                else if (t.conditionDeadline) {
+                    offer(t.PID, t.conditionDeadline, STAGE_TIMEOUT);
+                }
+                else if (!t.indefinite()) {
+                    offer(t.PID, now + t.conditionWait, STAGE_TIMEOUT);
+                }
+            }
+            end = i >= tasks.size();
+        }
+        for (size_t c = 0; c < nChildren; c++) {
+            // the child's own earliest deadline, an idle child has none
+            UpcomingDeadline d;
+            if (children[c]->upcomingDeadlines(&d, 1, tasksPerLock)) {
+                offer(childPIDs[c], now + d.inMs, STAGE_EXECUTE);
+            }
+        }
+        if (end) break;
+    }
+#endif
+    std::sort_heap(out, out + filled, deadlineEarlier);
+    return filled;
+}
+
+#if SCHEDULER_PROFILING
+void Scheduler::enableProfiling(uint32_t windowMs) {
+    MuxGuard lock(&schedMux);
+    profileWindowMs = windowMs;
+    profileStartMs = clockMs();
+    profileEpoch = 0;
+    for (Task& t : tasks) {
+        t.profCur = t.profPrev = Task::ProfileWindow();
+        t.profEpoch = 0;
+    }
+}
+
+static uint32_t profileKeyValue(const Scheduler::ProfileEntry& e, Scheduler::ProfileKey key) {
+    switch (key) {
+        case Scheduler::PROFILE_CONDITION: return e.conditionUs;
+        case Scheduler::PROFILE_RATE:      return e.runs;
+        case Scheduler::PROFILE_LATENESS:  return e.maxLatenessMs;
+        default:                           return e.execUs;
+    }
+}
+
+size_t Scheduler::profileTop(ProfileEntry* out, size_t n, ProfileKey key) const {
+    if (!profileWindowMs || !out || !n) return 0;
+    const uint32_t sinceStart = clockMs() - profileStartMs;
+    const uint32_t epoch = sinceStart / profileWindowMs;
+    // share of the previous window still inside the sliding window, in 1/1024
+    const uint32_t prevWeight = 1024 - (uint32_t)((uint64_t)(sinceStart % profileWindowMs) * 1024 / profileWindowMs);
+
+    size_t filled = 0;
+    for (size_t i = 0; ; i++) {
+        ProfileEntry e;
+        {
+            MuxGuard lock(&schedMux);
+            if (i >= tasks.size()) break;
+            const Task& t = tasks[i];
+            Task::ProfileWindow cur, prev;
+            if (t.profEpoch == epoch) {
+                cur = t.profCur;
+                prev = t.profPrev;
+            } else if (t.profEpoch + 1 == epoch) {
+                prev = t.profCur;
+            }
+            e.PID = t.PID;
+            e.execUs = cur.execUs + (uint32_t)((uint64_t)prev.execUs * prevWeight >> 10);
+            e.conditionUs = cur.conditionUs + (uint32_t)((uint64_t)prev.conditionUs * prevWeight >> 10);
+            e.runs = cur.runs + (prev.runs * prevWeight >> 10);
+            e.maxLatenessMs = cur.maxLatenessMs > prev.maxLatenessMs ? cur.maxLatenessMs : prev.maxLatenessMs;
+        }
+        // insert into the sorted top n
+        const uint32_t v = profileKeyValue(e, key);
+        size_t pos = filled;
+        while (pos > 0 && profileKeyValue(out[pos - 1], key) < v) pos--;
+        if (pos >= n) continue;
+        const size_t last = filled < n ? filled : n - 1;
+        for (size_t k = last; k > pos; k--) out[k] = out[k - 1];
+        out[pos] = e;
+        if (filled < n) filled++;
+    }
+    return filled;
+}
+#endif
+
+bool Scheduler::taskStats(size_t index, TaskStats& out) const {
+    MuxGuard lock(&schedMux);
+    if (index >= tasks.size()) return false;
+    const Task& t = tasks[index];
+    out.PID = t.PID;
+    out.runs = t.runs;
+    out.worstExecUs = t.worstExecUs;
+    out.overruns = t.overruns;
+    out.priority = t.priority;
+    out.interval = t.repeat ? t.interval : 0;
     return true;
 }
 
     // Adapt a task repeat interval by PID
     // Returns true if the task was found, is a repeating task, and was updated
-bool Scheduler::setRepeatingTaskInterval(PID_t pid, uint32_t interval){
+bool Scheduler::setRepeatingTaskInterval(PID_t pid, uint32_t interval, AddStatus* status){
     if(inLoop){
         gLogger->println("ERROR: Cannot modify task from within loop");
         return false;
     }
 
-    MuxGuard lock(&schedMux);
-    for (Task &t : tasks) {
-        if (t.PID == pid) {
-            if (!t.repeat) return false; // Not a repeating task
-            
+    AddStatus admission = ADD_OK;
+    {
+        MuxGuard lock(&schedMux);
+        Task* t = findTask(pid);
+        if (!t) return false; // Task not found
+        if (!t->repeat) return false; // Not a repeating task
+
+        if (admissionEnabled) {
+            // a shorter interval must fit the budget like a new task
+            Task probe;
+            probe.PID = t->PID;
+            probe.runs = t->runs;
+            probe.worstExecUs = t->worstExecUs;
+            probe.costUs = t->costUs;
+            probe.interval = interval;
+            admission = admit(probe);
+            interval = probe.interval;
+        }
+        if (admission != ADD_REJECTED_LOAD) {
             // Update interval, postConditionDelay = interval here as
             // we are modifying a repeating task, this is the most intuitive
             // way to understand it
-            t.postConditionDelay = interval;
-            t.interval = interval;
+            t->postConditionDelay = interval;
+            t->interval = interval;
+            updateLoad(*t);
+            tapSubmitted(SchedulerTap::SUBMIT_INTERVAL, pid, interval);
             //reset to be scheduled again
-            t.executeAt = 0;
-            return true;
+            t->executeAt = 0;
+#if SCHEDULER_INDEXED
+            if (t->conditionMet) armed(*t, clockMs());
+#endif
         }
     }
-    return false; // Task not found
+    if (status) *status = admission;
+    if (admission == ADD_REJECTED_LOAD) {
+        gLogger->println("Admission control: interval over the utilization budget, not changed");
+        return false;
+    }
+    wake();
+    return true;
 }
 
 
 uint32_t Scheduler::timeToNextTask() const{
+    // child schedulers are asked after our lock is released, they take their own
+    std::vector<Scheduler*> kids;
+    uint32_t minTime = timeToNextOwnTask(kids);
+    for (size_t i = 0; minTime && i < kids.size(); i++) {
+        const uint32_t childTime = kids[i]->timeToNextTask();
+        if (childTime < minTime) minTime = childTime;
+    }
+    return minTime;
+}
+
+// timeToNextTask() without the children, which are collected into kids
+uint32_t Scheduler::timeToNextOwnTask(std::vector<Scheduler*>& kids) const{
 
     MuxGuard lock(&schedMux);
     uint32_t minTime = 60000; //one minute max
-    if(tasks.empty())
-        return minTime; //no tasks
-    uint32_t now = millis();
+    if(tasks.empty() || onHold)
+        return minTime; //no tasks, or none run before resume() (which wakes)
+    uint32_t now = clockMs();
+    if (!timeoutHeap.empty()) {
+        // the next condition timeout, possibly of a stale entry => at worst an early wakeup
+        int32_t timeLeft = (int32_t)(timeoutHeap.front().deadline - now);
+        if (timeLeft <= 0) return 0;
+        if ((uint32_t)timeLeft < minTime) minTime = timeLeft;
+    }
+#if SCHEDULER_INDEXED
+    // tasks to arm and conditions polled without a deadline => at once
+    if (!toArm.empty()) return 0;
+    for (size_t i = 0; conditionPolling && i < waiting.size(); i++) {
+        const Task* t = findTask(waiting[i]);
+        if (t && !t->conditionMet && !t->conditionDeadline) return 0;
+    }
+    while (!execHeap.empty() && !isLive(execHeap.front())) {
+        std::pop_heap(execHeap.begin(), execHeap.end(), ExecEntry::later);
+        execHeap.pop_back();
+    }
+    if (!execHeap.empty()) {
+        // the next execution (or rate limiter token)
+        const int32_t timeLeft = (int32_t)(execHeap.front().at - now);
+        if (timeLeft <= 0) return 0;
+        if ((uint32_t)timeLeft < minTime) minTime = timeLeft;
+    }
+    for (PID_t pid : children) {
+        const Task* t = findTask(pid);
+        if (t && t->child) kids.push_back(t->child);
+    }
+#else
     for (const Task &t : tasks) {
+        if (t.child) {
+            kids.push_back(t.child); // aggregated deadline of the child scheduler
+            continue;
+        }
+        if (!t.conditionMet && (t.conditionDeadline || t.signalled)) {
+            // waiting for a condition, its deadline is covered by timeoutHeap,
+            // or a dormant signalled task
+            continue;
+        }
+        if (!t.conditionMet && !t.timed && !conditionPolling) {
+            continue; // condition without timeout, evaluated when loop() runs anyway
+        }
         if (t.executeAt == 0) {
             return 0; // at least one Task needs to be initialised immediately
         }
-        long timeLeft = (long)(t.executeAt - now);
+        int32_t timeLeft = (int32_t)(t.executeAt - now);
+        if (t.bucket && t.conditionMet) {
+            // not due before the next token is available
+            const int32_t tokenIn = (int32_t)t.bucket->msUntilToken(now);
+            if (tokenIn > timeLeft) timeLeft = tokenIn;
+        }
         if (timeLeft < 0) {
             // Task is ready to run
             return 0;
         }
-        if (timeLeft < minTime) {
+        if ((uint32_t)timeLeft < minTime) {
             minTime = timeLeft;
         }
     }
+#endif
     return minTime;
 }
 
@@ -236,6 +1330,11 @@ void Scheduler::stop(){
     for(auto &t : tasks){
         tasksToRemove.push_back(t.PID);
     }
+    // their producers and continuations go as well, but stop() may be called from a
+    // continuation still using its slot: mark them, loop() resets them at its safe point
+    for (FutureSlot& fs : futureSlots) {
+        if (fs.used) fs.stopped = futureResetPending = true;
+    }
 }
 
 
@@ -244,12 +1343,18 @@ void Scheduler::stop(){
 // ----------------------------------------------------
 
 void Scheduler::loop() {
+#if SCHEDULER_TAP
+    TapLoopScope tapScope(tap);
+#endif
+
+    recordLoopGap();
 
     // the beginning of the loop is a safe point to clear tasks marked for removal etc.
     // in a real concurrent setting it should be guarded with a mutex
     // but here we are in a single-threaded environment
     {
         MuxGuard lock(&schedMux);
+        if (futureResetPending) resetFutureSlots(true); // left by stop()
         if (tasks.empty() || onHold) return;
     }
     {
@@ -267,8 +1372,12 @@ void Scheduler::loop() {
     // now we enter the loop, so we should not be able to modify the task list anymore
     // while tasks might change it from within etc.
     ScopedFlag guard(inLoop);
+    LoopTimer timer(*this);
     
-    unsigned long now = millis();
+    const uint32_t now = clockMs();
+#if SCHEDULER_PROFILING
+    if (profileWindowMs) profileEpoch = (uint32_t)(now - profileStartMs) / profileWindowMs;
+#endif
 
     if (!sequentialMode) {
         // =========================================================
@@ -278,99 +1387,274 @@ void Scheduler::loop() {
         std::vector<PID_t> execPIDs;
         std::vector<PID_t> removePIDs;
         std::vector<PID_t> timeoutPIDs; 
+        std::vector<std::pair<PID_t, Scheduler*>> childTasks; // asked outside our lock
         execPIDs.reserve(8); removePIDs.reserve(8);
         timeoutPIDs.reserve(4);
 
         {
             MuxGuard lock(&schedMux);
+            // not set up yet (or a repeating task after its run) => arm it
+            auto arm = [&](Task& t) {
+                if (t.timed) {
+                    // trivially true condition => no need to evaluate it
+                    t.conditionMet = true;
+                    t.setExecutionTime(now + t.postConditionDelay);
+                    armed(t, now);
+                    return;
+                }
+                if (!t.indefinite() && t.conditionDeadline == 0) {
+                    // we have a finite conditionWait => set a "deadline" for condition
+                    t.setConditionDeadline(now + t.conditionWait);
+                    timeoutHeap.push_back({t.conditionDeadline, t.PID});
+                    std::push_heap(timeoutHeap.begin(), timeoutHeap.end(), TimeoutEntry::later);
+                    // but we haven't met condition yet, so we'll check in the next pass
+                }
+                // indefinite wait => no "deadline" for condition,
+                // the condition is evaluated (within budget) in the next pass
+#if SCHEDULER_INDEXED
+                waiting.push_back(t.PID);
+#endif
+            };
+#if SCHEDULER_INDEXED
+            // only the tasks queued for it
+            for (PID_t pid : toArm) {
+                Task* t = findTask(pid);
+                if (t && !t->conditionMet) arm(*t);
+            }
+            toArm.clear();
+#else
             size_t originalSize = tasks.size();
             //this is actually a short loop; most tasks will be already set up
             for (size_t i = 0; i < originalSize; i++) {
                 Task &t = tasks[i];
     
-                // If t.executeAt == 0 => we haven't set up the wait 
-                // for condition or postConditionDelay
-                if (t.executeAt == 0) {
-                    
-                    if (t.indefinite()) {
-                        // indefinite wait => no "deadline" for condition
-                        // if condition is not met yet, we keep checking
-                        // if condition is met, we set postConditionDelay
-                        if (t.conditionTrue()) {
-                            // condition is instantly met => set executeAt = now + postConditionDelay
-                            t.conditionMet = true;
-                            t.setExecutionTime(now + t.postConditionDelay);
-                        } 
-                    } 
-                    else {
-                        // we have a finite conditionWait => set a "deadline" for condition
-                        t.setExecutionTime( now + t.conditionWait);
-                        // but we haven't met condition yet, so we'll check in next pass
-                    }
-                }
+                if (t.conditionMet || t.signalled || t.child) continue;
+                arm(t);
             }
+#endif
         } // muxGuard lock;
 
         // Now do a second pass to see which tasks are ready to either:
-        //  - run if conditionMet and now >= postConditionDelay
-        //  - or become conditionMet if condition is now true
+        //  - become conditionMet if condition is now true
         //  - or time out if we passed the conditionWait
+        //  - run if conditionMet and now >= postConditionDelay
+        // Conditions are visited round-robin starting at conditionCursor, within the budget.
         {
             MuxGuard lock(&schedMux);
-            for (Task& t : tasks) {
+#if SCHEDULER_INDEXED
+            const size_t n = waiting.size(); // conditional tasks only
+            size_t dropped = 0;
+#else
+            const size_t n = tasks.size();
+#endif
+            if (conditionCursor >= n) conditionCursor = 0;
+            const unsigned long budgetStart = conditionBudgetUs ? clockUs() : 0;
+            uint16_t evaluations = 0;
+            size_t resumeAt = n; // first task skipped for lack of budget => starts the next round
+
+            auto budgetLeft = [&]() {
+                if (conditionBudgetCount && evaluations >= conditionBudgetCount) return false;
+                if (conditionBudgetUs && (uint32_t)(clockUs() - budgetStart) >= conditionBudgetUs) return false;
+                return true;
+            };
+
+            for (size_t k = 0; k < n; k++) {
+                const size_t i = (conditionCursor + k) % n;
+#if SCHEDULER_INDEXED
+                Task* tp = findTask(waiting[i]);
+                if (!tp || tp->conditionMet) {
+                    dropped++; // gone or met, compacted below
+                    continue;
+                }
+                Task& t = *tp;
+#else
+                Task& t = tasks[i];
                 
-                if (!t.condition) {
-                    gLogger->println("ERROR: Task has no condition!");
-                    // set it to trivially true
-                    t.condition = [](){return true;};
+                if (t.conditionMet || t.signalled || t.child) continue;
+#endif
+
+                // a condition at or past its deadline is left to the timeout expiry below
+                if (t.conditionDeadline && (int32_t)(now - t.conditionDeadline) >= 0) continue;
+
+                const bool stale = conditionStalenessMs &&
+                                   (uint32_t)(now - t.lastConditionCheck) >= conditionStalenessMs;
+                if (!stale && !budgetLeft()) {
+                    if (resumeAt == n) resumeAt = i;
+                    continue;
                 }
-    
-                if (!t.conditionMet) {
-                    // Condition not yet met
-                    if (t.conditionTrue()) {
-                        // Condition just became true => set conditionMet
-                        t.conditionMet = true;
-                        // Now we do postConditionDelay
-                        // if t.executeAt was a "condition deadline," we ignore it
-                        t.setExecutionTime(now + t.postConditionDelay);
-                    } 
-                    else {
-                        // condition still false => check if we timed out
-                        if (!t.indefinite()) {
-                            if ((long)(now - t.executeAt) >= 0) {
-                                // timed out => schedule removal and timeout callback (PID-only, like execPIDs)
-                                removePIDs.push_back(t.PID);
-                                timeoutPIDs.push_back(t.PID);
-                            }
-                        }
-                    }
+                evaluations++;
+                t.lastConditionCheck = now;
+
+                if (evaluateCondition(t)) {
+                    // Condition just became true => set conditionMet
+                    t.conditionMet = true;
+                    // Now we do postConditionDelay, the condition deadline is dropped
+                    t.conditionDeadline = 0;
+                    t.setExecutionTime(now + t.postConditionDelay);
+                    armed(t, now);
                 } 
+            }
+            if (resumeAt != n) conditionCursor = resumeAt;
+#if SCHEDULER_INDEXED
+            if (dropped) {
+                // compact, the round-robin position moves along
+                size_t w = 0, cursor = 0;
+                for (size_t r = 0; r < n; r++) {
+                    if (r == conditionCursor) cursor = w;
+                    const Task* t = findTask(waiting[r]);
+                    if (t && !t->conditionMet) waiting[w++] = waiting[r];
+                }
+                waiting.resize(w);
+                conditionCursor = cursor;
+            }
+#endif
+
+            // Expire condition deadlines from the timeout index in deadline order, O(expired).
+            // The condition is evaluated one last time regardless of the budget,
+            // so the timeout decision is exact.
+            while (!timeoutHeap.empty() && (int32_t)(now - timeoutHeap.front().deadline) >= 0) {
+                std::pop_heap(timeoutHeap.begin(), timeoutHeap.end(), TimeoutEntry::later);
+                const TimeoutEntry e = timeoutHeap.back();
+                timeoutHeap.pop_back();
+
+                Task* t = getTaskByPID(e.PID); // not locked here
+                if (!t || t->conditionMet || t->conditionDeadline != e.deadline) continue; // stale entry
+                t->lastConditionCheck = now;
+
+                // a signalled task has nothing to evaluate, not signalled in time => timed out
+                if (!t->signalled && evaluateCondition(*t)) {
+                    t->conditionMet = true;
+                    t->conditionDeadline = 0;
+                    t->setExecutionTime(now + t->postConditionDelay);
+                    armed(*t, now);
+                }
                 else {
-                    // conditionMet => we are waiting for "executeAt"
-                    if ((long)(now - t.executeAt) >= 0) {
-                        execPIDs.push_back(t.PID);
+                    // timed out => schedule removal and timeout callback (PID-only, like execPIDs)
+                    removePIDs.push_back(t->PID);
+                    timeoutPIDs.push_back(t->PID);
+                }
+            }
+
+            // a due task => execute, or shed under overload. Rate limited tasks are due once
+            // a token is available; only an executed run takes it, a shed one leaves it.
+            // Returns false if rate limited (stays due)
+            auto dispatch = [&](Task& t) {
+                const bool shed = overloaded && t.repeat && t.priority < overloadConfig.shedBelowPriority;
+                if (t.bucket && (shed ? t.bucket->msUntilToken(now) != 0 : !t.bucket->tryTake(now))) return false;
+                const uint32_t late = now - t.executeAt;
+                if (late > loopMaxLatenessMs) loopMaxLatenessMs = late;
+#if SCHEDULER_PROFILING
+                if (profileWindowMs) {
+                    Task::ProfileWindow& w = profileWindow(t);
+                    if (late > w.maxLatenessMs) w.maxLatenessMs = late > 0xFFFF ? 0xFFFF : late;
+                }
+#endif
+
+                if (shed) {
+                    // skip to the next interval or retry later
+                    shedRuns++;
+                    if (overloadConfig.skip) {
+                        t.conditionMet = false;
+                        t.postConditionDelay = t.interval;
+                        t.executeAt = 0;
+                        needsArming(t);
+                    } else {
+                        t.setExecutionTime(now + overloadConfig.deferMs);
+                        armed(t, now);
                     }
+                    return true;
                 }
+                execPIDs.push_back(t.PID);
+                return true;
+            };
+#if SCHEDULER_INDEXED
+            // due entries in deadline order, O(due * log n). Collected first, dispatch()
+            // may re-arm a task; rate limited entries go back in with the token time.
+            std::vector<Task*> due;
+            while (!execHeap.empty() && (int32_t)(now - execHeap.front().at) >= 0) {
+                std::pop_heap(execHeap.begin(), execHeap.end(), ExecEntry::later);
+                const ExecEntry e = execHeap.back();
+                execHeap.pop_back();
+                if (!isLive(e)) continue; // stale entry
+                due.push_back(findTask(e.PID));
+            }
+            for (Task* t : due) {
+                if (dispatch(*t)) continue;
+                const uint32_t tokenIn = t->bucket->msUntilToken(now);
+                scheduleExecution(*t, now + (tokenIn ? tokenIn : 1));
             }
+            // child schedulers => due when their earliest deadline is, see below
+            for (size_t i = 0; i < children.size(); ) {
+                const Task* t = findTask(children[i]);
+                if (!t || !t->child) {
+                    children.erase(children.begin() + i);
+                    continue;
+                }
+                childTasks.push_back(std::make_pair(t->PID, t->child));
+                i++;
+            }
+#else
+            // conditionMet => we are waiting for "executeAt", keep the task order for execution
+            for (Task& t : tasks) {
+                if (t.child) {
+                    // child scheduler => due when its earliest deadline is, see below
+                    childTasks.push_back(std::make_pair(t.PID, t.child));
+                    continue;
+                }
+                if (t.conditionMet && (int32_t)(now - t.executeAt) >= 0) {
+                    dispatch(t); // rate limited => stays due until a token is available
+                }
+            }
+#endif
         }//muxGuard lock;
+
+        // a child takes its own lock, so it is only asked with ours released
+        for (const auto& c : childTasks) {
+            if (c.second->timeToNextTask() == 0) execPIDs.push_back(c.first);
+        }
         
         // Execute tasks
-        for (auto epid : execPIDs) {
-            auto act = getTaskActionByPID(epid);
+        for (size_t x = 0; x < execPIDs.size(); x++) {
+            const PID_t epid = execPIDs[x];
+            uint32_t budgetUs = 0;
+            auto act = getTaskActionByPID(epid, &budgetUs);
             if (!act) continue; // Task not found, skip
             
-            #ifdef HIGHLY_VERBOSE
+            #if SCHEDULER_VERBOSE
             gLogger->println("Executing task...");
             gLogger->println(epid);
             #endif
 
+            const unsigned long execStart = clockUs();
+            stageBegin(epid, STAGE_EXECUTE, budgetUs);
             act();
+            const bool overBudget = stageEnd();
+            const uint32_t execUs = clockUs() - execStart;
             
             MuxGuard lock(&schedMux); // lock access to tasksToRemove and tasks
+            Task* done = getTaskByPID(epid); //not locked here
+            if (done) {
+                done->runs++;
+                if (execUs > done->worstExecUs) done->worstExecUs = execUs;
+                if (overBudget) done->overruns++;
+                if (done->repeat) updateLoad(*done);
+#if SCHEDULER_PROFILING
+                if (profileWindowMs) {
+                    Task::ProfileWindow& w = profileWindow(*done);
+                    w.execUs += execUs;
+                    if (w.runs < 0xFFFF) w.runs++;
+                }
+#endif
+            }
+#if SCHEDULER_STOP_IN_CALLBACK
             if(will_stop){
                 //now, we might have added to the task list within onExecute.
                 //we want to keep those new tasks, but mark all others for removal
                 //and don't execute them
+                for (size_t r = x + 1; r < execPIDs.size(); r++) {
+                    Task* skipped = getTaskByPID(execPIDs[r]);
+                    if (skipped && skipped->bucket) skipped->bucket->refund(); // taken when collected
+                }
                 execPIDs.clear();
                 will_stop = false;
 
@@ -378,56 +1662,66 @@ void Scheduler::loop() {
                     Task * t2 = getTaskByPID(p); //not locked here
                     if (t2) { 
                         t2->repeat = false; 
+                        t2->persistent = false; 
+                        t2->child = nullptr; 
+                        updateLoad(*t2);
                         execPIDs.push_back(p); 
                     } //this mimics that the task was just executed
                 }
                 tasksToRemove.clear();
                 break;
             }
+#endif
             //stop execution if stop was called from within a task,
             //clear will happen later anyway so rest can run through
         }
 
         // Remove or reschedule tasks that were executed or timed out
-        for (auto epid : execPIDs) {
-            bool success;
-            Task  t = copyTaskByPID(epid, success);
-            if(!success) continue; // Task not found, skip
-
-            if (t.repeat) {
-                // For repeated tasks => reset condition (?), recheck from scratch
-                t.conditionMet = false;
-                t.postConditionDelay = t.interval;//set to interval
-                t.executeAt = 0;//set it to a fresh state
-                modifyTaskByPID(t.PID, t); // update the task
-            } else {
-                removePIDs.push_back(t.PID);
+        {
+            MuxGuard lock(&schedMux); // in place, no copy of the task
+            for (auto epid : execPIDs) {
+                Task* t = getTaskByPID(epid);
+                if (!t) continue; // Task not found, skip
+
+                if (t->repeat) {
+                    // For repeated tasks => reset condition (?), recheck from scratch
+                    t->conditionMet = false;
+                    t->postConditionDelay = t->interval;//set to interval
+                    t->executeAt = 0;//set it to a fresh state
+                    needsArming(*t);
+                } else if ((t->signalled && t->persistent) || t->child) {
+                    // stays in its slot, dormant (or re-armed from within its run)
+                } else {
+                    removePIDs.push_back(t->PID);
+                }
             }
         }
-        //dedup timeout pids to avoid calling onTimeout multiple times for the same task
-        if (!timeoutPIDs.empty()) {
-            std::sort(timeoutPIDs.begin(), timeoutPIDs.end());
-            timeoutPIDs.erase(std::unique(timeoutPIDs.begin(), timeoutPIDs.end()), timeoutPIDs.end());
-        }
-        // Invoke timeout callbacks (outside lock), mirroring exec flow (get callback by PID, then call)
+        // Invoke timeout callbacks (outside lock) in deadline order, each task has at most one
+        // live entry in the timeout index. Mirrors exec flow (get callback by PID, then call)
         for (auto tpid : timeoutPIDs) {
-            auto cb = getTaskTimeoutByPID(tpid); // copies the std::function while holding the lock internally
-            if (cb) cb(tpid);
+            uint32_t budgetUs = 0;
+            auto cb = getTaskTimeoutByPID(tpid, &budgetUs); // copies the std::function while holding the lock internally
+            if (!cb) continue;
+            stageBegin(tpid, STAGE_TIMEOUT, budgetUs);
+            cb(tpid);
+            stageEnd();
         }
         //find all tasks that are marked for removal
     {
-        std::sort(removePIDs.begin(), removePIDs.end());
-        removePIDs.erase(std::unique(removePIDs.begin(), removePIDs.end()), removePIDs.end());
         MuxGuard lock(&schedMux);
         for (PID_t pid : removePIDs) { //I don't care about duplicates here
-            auto it = std::find_if(tasks.begin(), tasks.end(),
-                                   [pid](const Task& t){ return t.PID == pid; });
-            if (it != tasks.end()) tasks.erase(it);
+            eraseTask(pid);
         }
+#if SCHEDULER_INDEXED
+        compactHeaps();
+#endif
     }
 
-        
+        // spare time left => background work
+        runBackground();
+
     } // end of parallel mode, there is nothing after this
+#if SCHEDULER_SEQUENTIAL
     else {
         // =========================================================
         // SEQUENTIAL MODE: only front matters
@@ -464,7 +1758,7 @@ void Scheduler::loop() {
 
         if (!t.conditionMet) {
             // Condition not yet met
-            if (t.conditionTrue()) {
+            if (evaluateCondition(t)) {
                 // Just became true => set conditionMet => schedule postConditionDelay
                 t.conditionMet = true;
                 t.setExecutionTime(now + t.postConditionDelay);
@@ -473,7 +1767,7 @@ void Scheduler::loop() {
             else {
                 // not met => check if we timed out
                 if (!t.indefinite()) {
-                    if ((long)(now - t.executeAt) >= 0) {
+                    if ((int32_t)(now - t.executeAt) >= 0) {
                         // timed out => remove
                         removeThisTask = true;
                     }
@@ -482,7 +1776,7 @@ void Scheduler::loop() {
         }
         else {
             // condition was met => check if now >= t.executeAt
-            if ((long)(now - t.executeAt) >= 0) {
+            if ((int32_t)(now - t.executeAt) >= 0) {
                 // run
                 executeThisTask = true;
             }
@@ -491,48 +1785,42 @@ void Scheduler::loop() {
         if (removeThisTask) {
             // fire timeout callback outside lock, before removal
             if (t.onTimeout) {
+                stageBegin(t.PID, STAGE_TIMEOUT, t.budgetUs);
                 t.onTimeout(t.PID);
+                stageEnd();
             }
             MuxGuard lock(&schedMux);
             //we need to find the task again by PID
-            auto it = std::find_if(tasks.begin(), tasks.end(),
-                                   [t](const Task& tk){ return tk.PID == t.PID; });
-            if (it != tasks.end()) {
-                tasks.erase(it); // remove it
-            }
+            eraseTask(t.PID);
             lastSequentialFinishTime = now;
             return;
         }
         else if (executeThisTask) {
+            stageBegin(t.PID, STAGE_EXECUTE, t.budgetUs);
             t.onExecute();
+            stageEnd();
             // also here we might have called stop from within a task, but might have also added new ones
             // so we need to clear all tasks that existed before the onExecute call, they can be found in tasksToRemove
             
             MuxGuard lock(&schedMux);
+#if SCHEDULER_STOP_IN_CALLBACK
             if(will_stop){ //doesn't happen that often.
                 will_stop = false;
 
                 //erase all tasks in removal list
                 for(const auto pid : tasksToRemove){
-                    auto it = std::find_if(tasks.begin(), tasks.end(), [pid](const Task &t) { return t.PID == pid; });
-                    // NEW: only remove tasks that are not the currently handled one
-                    if (it != tasks.end()) {
-                        //here we can erase directly as only this task will run in this loop
-                        tasks.erase(it);
-                    }
+                    //here we can erase directly as only this task will run in this loop
+                    eraseTask(pid);
                 }
                 tasksToRemove.clear();
 
                 lastSequentialFinishTime = now;
                 return;
             }
+#endif
             //still protected by the MuxGuard, so we can safely modify tasks
             //will be fast if it starts in the beginning
-            auto it = std::find_if(tasks.begin(), tasks.end(),
-                                   [t](const Task& tk){ return tk.PID == t.PID; });
-            if (it != tasks.end()) {
-                tasks.erase(it);
-            }
+            eraseTask(t.PID);
             lastSequentialFinishTime = now;
             return;
         }
@@ -540,4 +1828,5 @@ void Scheduler::loop() {
             modifyTaskByPID(t.PID, t);
         }
     }
-}
\ No newline at end of file
+#endif
+}
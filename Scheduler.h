@@ -5,6 +5,18 @@
 #include <vector>
 #include <functional>
 #include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <new>
+#include "SchedulerConfig.h"
+#include "ScheduleAnalysis.h"
+
+#if SCHEDULER_INDEXED
+#if SCHEDULER_SEQUENTIAL
+#error "SCHEDULER_INDEXED needs SCHEDULER_SEQUENTIAL 0, sequential mode relies on the list order"
+#endif
+#include <unordered_map>
+#endif
 
 /*
   A single unified Task struct:
@@ -18,9 +30,69 @@
    - repeat & interval: if in parallel mode, can repeat. 
      Not supported in sequential mode => forcibly disabled.
 */
-// typedef PID from uin16_t, enough for 65535 tasks, more than enough or all microcontroller purposes
-// a PID is never zero (so we can use it as a "null" PID)
-typedef uint16_t PID_t;
+// PID type, uint16_t by default: enough for 65535 tasks, more than enough for all microcontroller purposes
+// (see SCHEDULER_PID_TYPE). A PID is never zero (so we can use it as a "null" PID)
+typedef SCHEDULER_PID_TYPE PID_t;
+
+// Result slots for Future<T>, owned by the Scheduler (no heap allocated shared state).
+// A result type must fit into SCHEDULER_FUTURE_SLOT_SIZE bytes.
+#ifndef SCHEDULER_FUTURE_SLOTS
+#define SCHEDULER_FUTURE_SLOTS 8
+#endif
+#ifndef SCHEDULER_FUTURE_SLOT_SIZE
+#define SCHEDULER_FUTURE_SLOT_SIZE 16
+#endif
+
+// Buckets of the loop() call gap histogram: bucket i counts gaps below 2^i ms,
+// the last one everything longer
+#ifndef SCHEDULER_LOOP_GAP_BUCKETS
+#define SCHEDULER_LOOP_GAP_BUCKETS 12
+#endif
+
+// Observes (recording) or substitutes (replay) the inputs of a Scheduler: clock reads,
+// condition outcomes and submissions. See SessionRecorder.h and tools/SessionReplay.h.
+// Called from loop() and the add/signal functions, partly with the scheduler lock held,
+// so implementations must not block or call back into the scheduler.
+class SchedulerTap {
+public:
+    enum Submission : uint8_t {
+        SUBMIT_TIMED = 0x10,   // a = delayMs, b = repeat, c = interval
+        SUBMIT_CONDITIONAL,    // a = conditionWaitMs, b = postDelayMs, c = has onTimeout
+        SUBMIT_SIGNALLED,      // a = persistent, b = timeoutMs, c = has onTimeout
+        SUBMIT_SIGNAL,         // a = delayMs
+        SUBMIT_REMOVE,
+        SUBMIT_DISARM,
+        SUBMIT_INTERVAL,       // a = interval, setRepeatingTaskInterval()
+        SUBMIT_PRIORITY,       // a = priority
+        SUBMIT_HOLD,           // pid 0, a = 1 hold(), 0 resume()
+        SUBMIT_BACKGROUND      // addBackgroundTask()
+    };
+    virtual ~SchedulerTap() {}
+    virtual void loopBegin() {}
+    virtual void loopEnd() {}
+    // live is the current millis() (micro == false) or micros()
+    virtual uint32_t clock(bool /*micro*/, uint32_t live) { return live; }
+    // live evaluates the actual condition of task pid, or runs one chunk of background
+    // task pid and returns whether it has more to do
+    virtual bool condition(PID_t /*pid*/, const std::function<bool()>& live) { return live && live(); }
+    virtual void submitted(uint8_t /*kind*/, PID_t /*pid*/, uint32_t /*a*/, uint32_t /*b*/, uint32_t /*c*/) {}
+};
+
+#if SCHEDULER_WATCHDOG
+// Written by Scheduler::checkWatchdog() when a callback exceeds its budget.
+// Kept in memory that survives a (watchdog) reset where the platform has it.
+struct SchedulerCrashRecord {
+    uint32_t magic;
+    uint32_t count;     // trips recorded since the record was cleared
+    PID_t PID;          // offending task
+    uint8_t stage;      // Scheduler::STAGE_*
+    uint32_t elapsedUs; // time spent in the callback when detected
+    uint32_t budgetUs;
+};
+#endif
+
+template<typename T> class Future;
+class TokenBucket;
 
 
 class ScopedFlag {
@@ -41,6 +113,157 @@ private:
 };
 
 class Scheduler {
+public:
+    static const uint8_t PRIORITY_LOW = 64;
+    static const uint8_t PRIORITY_NORMAL = 128;
+    static const uint8_t PRIORITY_HIGH = 192;
+
+    // callback stages reported by the execution watchdog
+    static const uint8_t STAGE_NONE = 0;
+    static const uint8_t STAGE_CONDITION = 1;
+    static const uint8_t STAGE_EXECUTE = 2;
+    static const uint8_t STAGE_TIMEOUT = 3;
+    static const uint8_t STAGE_BACKGROUND = 4;
+
+    // Overload detection: the worst lateness of dispatched tasks and the busy fraction
+    // (loop() passes that ran a callback) are sampled per window and tracked as moving
+    // averages. Crossing an enter threshold starts shedding, all values back at or below
+    // the exit thresholds restores normal service (hysteresis).
+    // An exit threshold of 0 or above its enter threshold becomes 3/4 of enter.
+    struct OverloadConfig {
+        uint32_t windowMs = 100;        // sampling window
+        uint32_t enterLatenessMs = 0;   // 0 => lateness not used
+        uint32_t exitLatenessMs = 0;
+        uint16_t enterUtilPermille = 0; // 0 => utilization not used
+        uint16_t exitUtilPermille = 0;
+        // repeating tasks with a lower priority are shed while overloaded
+        uint8_t shedBelowPriority = PRIORITY_NORMAL;
+        // true => a shed run is skipped (next run one interval later),
+        // false => deferred by deferMs and retried
+        bool skip = true;
+        uint32_t deferMs = 100;
+    };
+
+    // Admission control for repeating tasks: the projected utilization is the sum of
+    // cost / interval over all repeating tasks, with the measured worst execution time
+    // as cost once a task ran, else its declared cost (addTimedTask(costUs)), else
+    // defaultCostUs. A new task that would push it over the budget gets a longer
+    // interval (degrade) or is rejected. Tasks without any known cost are admitted.
+    struct AdmissionConfig {
+        uint16_t budgetPermille = 700;
+        uint32_t defaultCostUs = 0;
+        bool degrade = true;         // false => reject instead
+        uint32_t maxIntervalMs = 0;  // longest degraded interval, 0 => no limit
+    };
+
+    // backoff of addRetryTask(): the n-th retry waits initialDelayMs * (multiplierPercent/100)^(n-1),
+    // capped at maxDelayMs, then spread by +-jitterPercent
+    struct RetryPolicy {
+        uint32_t initialDelayMs = 1000;
+        uint32_t maxDelayMs = 60000;      // 0 => no cap (delays stay below 2^31 ms either way)
+        uint16_t multiplierPercent = 200;
+        uint8_t jitterPercent = 10;       // at most 100
+        uint16_t maxAttempts = 5;         // including the first one, 0 => unlimited
+    };
+
+    // outcome of addTimedTask() and setRepeatingTaskInterval(), through their status argument
+    enum AddStatus : uint8_t {
+        ADD_OK = 0,
+        ADD_DEGRADED,       // admitted with a longer interval than requested
+        ADD_REJECTED_LOAD,  // over the admission control budget
+        ADD_REJECTED_FULL   // SCHEDULER_MAX_TASKS reached
+    };
+
+    struct OverloadStatus {
+        bool overloaded;
+        uint32_t latenessMs;     // moving average of the worst lateness per window
+        uint16_t utilPermille;   // moving average of loop() busy time per window
+        uint32_t shedRuns;       // runs skipped or deferred so far
+    };
+
+    // aggregate runtime metrics since resetMetrics(), see metrics()
+    struct Metrics {
+        uint32_t elapsedMs;
+        uint32_t loopCalls;
+        uint32_t workCalls;      // calls that ran at least one onExecute or onTimeout
+        uint32_t wakeups;        // work calls that followed an idle call
+        uint32_t dispatched;     // onExecute runs
+        uint32_t conditionEvals;
+        uint32_t timeouts;       // onTimeout runs
+        uint64_t busyUs;         // time spent in loop() passes that ran a callback
+        uint64_t idleUs;         // the rest of the elapsed time
+        uint64_t backgroundUs;   // time spent in background chunks, not part of busyUs
+        uint32_t maxLatenessMs;  // worst delay of a due task past its deadline
+        float loopCallsPerSec;
+        float workFraction;      // workCalls / loopCalls
+        float busyFraction;      // busyUs / elapsed
+        float dispatchedPerSec;
+        float conditionEvalsPerSec;
+        float timeoutsPerSec;
+        float wakeupsPerHour;
+    };
+
+    // see upcomingDeadlines()
+    struct UpcomingDeadline {
+        PID_t PID;
+        uint32_t deadline;  // millis() time
+        int32_t inMs;       // relative to the query, negative if overdue
+        uint8_t stage;      // STAGE_EXECUTE: the task runs, STAGE_TIMEOUT: its condition times out
+    };
+
+    // handed to a background chunk, see addBackgroundTask()
+    class BackgroundSlice {
+    public:
+        // true once the chunk should return: the slice is used up, or a submission
+        // (add*, signalTask(), notifyConditions(), ...) may have made foreground work due
+        bool shouldYield() const {
+            return s.wakeSeq != wakeSeq || (int32_t)(s.clockUs() - endUs) >= 0;
+        }
+        uint32_t remainingUs() const {
+            const int32_t left = (int32_t)(endUs - s.clockUs());
+            return left > 0 ? left : 0;
+        }
+    private:
+        friend class Scheduler;
+        BackgroundSlice(const Scheduler& sched, uint32_t end) : s(sched), endUs(end), wakeSeq(sched.wakeSeq) {}
+        const Scheduler& s;
+        uint32_t endUs;
+        uint32_t wakeSeq;
+    };
+
+#if SCHEDULER_PROFILING
+    // sort keys of profileTop()
+    enum ProfileKey : uint8_t { PROFILE_EXEC, PROFILE_CONDITION, PROFILE_RATE, PROFILE_LATENESS };
+
+    // one task over the sliding profile window
+    struct ProfileEntry {
+        PID_t PID;
+        uint32_t execUs;        // onExecute time
+        uint32_t conditionUs;   // condition evaluation time
+        uint32_t runs;
+        uint32_t maxLatenessMs;
+    };
+#endif
+
+    // per-task counters, see taskStats()
+    struct TaskStats {
+        PID_t PID;
+        uint32_t runs;
+        uint32_t worstExecUs;
+        uint16_t overruns;   // callbacks over the watchdog budget
+        uint8_t priority;
+        uint32_t interval;   // 0 if not repeating
+    };
+
+    // gaps between consecutive loop() calls, i.e. time the application spent elsewhere
+    struct LoopGapStats {
+        uint32_t calls;
+        uint32_t lastGapUs;
+        uint32_t maxGapUs;       // since the last reset
+        uint32_t starved;        // gaps above the starvation threshold
+        uint32_t histogram[SCHEDULER_LOOP_GAP_BUCKETS];
+    };
+
 private:
 
     
@@ -58,6 +281,52 @@ private:
         // The condition to become true. If it's trivial "return true;" => purely timed
         std::function<bool()> condition = nullptr;
         bool conditionMet = false;
+        // set for addTimedTask: condition is trivially true and never needs evaluating
+        bool timed = false;
+        // set for addSignalledTask: dormant (conditionMet == false) until signalTask() arms it,
+        // or until its conditionDeadline if it has a timeout
+        bool signalled = false;
+        // signalled tasks only: return to dormant after running instead of being removed
+        bool persistent = false;
+        // optional rate limiter: the task is not due while the bucket is empty
+        TokenBucket* bucket = nullptr;
+        // child scheduler task: due when the child's next deadline is, runs child->loop()
+        Scheduler* child = nullptr;
+        // background task: a dormant signalled task, its chunk is in background
+        bool background = false;
+
+        // measured in parallel mode
+        uint32_t runs = 0;
+        uint32_t worstExecUs = 0; // longest onExecute so far
+
+        // repeating tasks below OverloadConfig::shedBelowPriority are shed under overload
+        uint8_t priority = PRIORITY_NORMAL;
+
+        // declared execution time of a repeating task, for admission control (0 => unknown)
+        uint32_t costUs = 0;
+        // this task's share of repeatingLoadPpm, see updateLoad()
+        uint32_t loadPpm = 0;
+
+        // execution watchdog budget per callback, 0 => the default budget
+        uint32_t budgetUs = 0;
+        uint16_t overruns = 0; // callbacks that finished over budget
+#if SCHEDULER_PROFILING
+        // profile window counters, current and previous window (profileEpoch)
+        struct ProfileWindow {
+            uint32_t execUs = 0;
+            uint32_t conditionUs = 0;
+            uint16_t runs = 0;
+            uint16_t maxLatenessMs = 0;
+        };
+        ProfileWindow profCur, profPrev;
+        uint32_t profEpoch = 0;
+#endif
+#if SCHEDULER_INDEXED
+        // arming sequence number of the live execHeap entry, older entries are stale
+        uint32_t armGen = 0;
+#endif
+        // last time (millis) the condition was evaluated, for the staleness bound
+        uint32_t lastConditionCheck = 0;
 
         // If conditionWait <= 0 => indefinite
         long conditionWait = 0;
@@ -65,11 +334,15 @@ private:
         // Once condition is met => wait postConditionDelay before running
         uint32_t postConditionDelay = 0;
 
-        // The absolute time (millis) at which the condition times out
-        // or at which we run the onExecute, depending on the stage.
+        // The absolute time (millis) at which we run the onExecute.
+        // In sequential mode also the time at which the condition times out.
         // We'll set this dynamically in the code.
         uint32_t executeAt = 0;
 
+        // Parallel mode: absolute time (millis) at which the condition times out,
+        // 0 => not armed. Indexed in timeoutHeap.
+        uint32_t conditionDeadline = 0;
+
         // If we are waiting indefinitely for the condition, or no conditionWait set
         // this is always true for repeating tasks
         bool indefinite() const {
@@ -82,25 +355,317 @@ private:
         void setExecutionTime(unsigned long time) {
             executeAt = (time == 0) ? 1 : time;
         }
+        void setConditionDeadline(unsigned long time) {
+            conditionDeadline = (time == 0) ? 1 : time;
+        }
 
     };
 
     // The container of tasks
     std::vector<Task> tasks;
 
+    // Condition deadlines of finite-wait tasks (parallel mode), kept as a min-heap
+    // separate from the execution times. Entries are dropped lazily: an entry is
+    // stale once its task is gone, met its condition or was re-armed.
+    struct TimeoutEntry {
+        uint32_t deadline;
+        PID_t PID;
+        // heap comparator => earliest deadline on top, wrap-around safe
+        static bool later(const TimeoutEntry& a, const TimeoutEntry& b) {
+            return (int32_t)(a.deadline - b.deadline) > 0;
+        }
+    };
+    std::vector<TimeoutEntry> timeoutHeap;
+
+#if SCHEDULER_INDEXED
+    // PID => position in tasks
+    std::unordered_map<PID_t, size_t> pidIndex;
+    // execution times of armed tasks, min-heap with lazily dropped stale entries
+    // (task gone, disarmed or re-armed: armGen differs). at is executeAt, or the
+    // time the next rate limiter token is due. Equal times run in arming order.
+    struct ExecEntry {
+        uint32_t at;
+        uint32_t armGen;
+        PID_t PID;
+        static bool later(const ExecEntry& a, const ExecEntry& b) {
+            if (a.at != b.at) return (int32_t)(a.at - b.at) > 0;
+            return (int32_t)(a.armGen - b.armGen) > 0;
+        }
+    };
+    mutable std::vector<ExecEntry> execHeap; // timeToNextTask() drops stale entries on top
+    uint32_t armSeq = 0;
+    // tasks to arm in the next loop() (added, or repeating tasks after their run)
+    std::vector<PID_t> toArm;
+    // conditional tasks still polling their condition, stale entries are compacted by loop()
+    std::vector<PID_t> waiting;
+    std::vector<PID_t> children;
+    void scheduleExecution(const Task& t, uint32_t at) {
+        execHeap.push_back({at, t.armGen, t.PID});
+        std::push_heap(execHeap.begin(), execHeap.end(), ExecEntry::later);
+    }
+    bool isLive(const ExecEntry& e) const {
+        const Task* t = findTask(e.PID);
+        return t && t->conditionMet && t->armGen == e.armGen;
+    }
+    void compactHeaps();
+    // whenever a task's executeAt is (re)armed in parallel mode
+    void armed(Task& t, uint32_t now);
+    // when a task is back to not armed (conditionMet == false) and has to be set up again
+    void needsArming(Task& t) { toArm.push_back(t.PID); }
+#else
+    void armed(Task&, uint32_t) {}
+    void needsArming(Task&) {}
+#endif
+    // caller must own schedMux
+    Task* findTask(PID_t pid) {
+#if SCHEDULER_INDEXED
+        const auto it = pidIndex.find(pid);
+        return it != pidIndex.end() ? &tasks[it->second] : nullptr;
+#else
+        for (Task& t : tasks) {
+            if (t.PID == pid) return &t;
+        }
+        return nullptr;
+#endif
+    }
+    const Task* findTask(PID_t pid) const { return const_cast<Scheduler*>(this)->findTask(pid); }
+    // erase by PID, caller must own schedMux. Returns false if not found
+    bool eraseTask(PID_t pid);
+    // append a new task, caller must own schedMux
+    void insertTask(const Task& t);
+
     // If true => strictly one-at-a-time in order
+#if SCHEDULER_SEQUENTIAL
     bool sequentialMode = false;
+#else
+    static const bool sequentialMode = false; // folds the sequential paths away
+#endif
 
     // In sequential mode, tasks reference the time the previous task finished
     uint32_t lastSequentialFinishTime = 0;
 
     bool will_stop = false;
     std::vector<PID_t> tasksToRemove;
+    bool futureResetPending = false; // stop() left slots for the next loop() to reset
+
+    // Condition evaluation budget per loop() call, 0 => unlimited
+    uint16_t conditionBudgetCount = 0;
+    uint32_t conditionBudgetUs = 0;
+    // A condition not evaluated for this long is evaluated regardless of the budget, 0 => off
+    uint32_t conditionStalenessMs = 0;
+    // false => pending conditions do not make timeToNextTask() 0, see setConditionPolling()
+    bool conditionPolling = true;
+
+    // called when work may have become due earlier than timeToNextTask() said
+    void (*wakeHook)(void*) = nullptr;
+    void* wakeContext = nullptr;
+    // counts wakes, a running background slice yields when it changes
+    volatile uint32_t wakeSeq = 0;
+    void wake() {
+        wakeSeq = wakeSeq + 1;
+        if (wakeHook) wakeHook(wakeContext);
+    }
+
+    // background chunks by PID, entries of removed tasks are dropped by runBackground()
+    struct BackgroundEntry {
+        PID_t PID;
+        std::function<bool(BackgroundSlice&)> chunk;
+    };
+    std::vector<BackgroundEntry> background;
+    size_t backgroundCursor = 0; // round-robin position
+    uint32_t backgroundSlackMs = 2;
+    uint32_t backgroundMaxSliceMs = 10;
+    uint32_t loopBackgroundUs = 0; // of the current loop() call, excluded from its busy time
+    // spare time at the end of loop() => run background chunks
+    void runBackground();
+    // round-robin start index for condition evaluation
+    size_t conditionCursor = 0;
+
+    // overload management, moving averages in 1/16 units
+    OverloadConfig overloadConfig;
+    std::function<void(bool)> onOverloadChange;
+    bool overloadEnabled = false;
+    bool overloaded = false;
+    uint32_t latenessAvg16 = 0;
+    uint32_t utilAvg16 = 0;
+    uint32_t shedRuns = 0;
+    uint32_t loopMaxLatenessMs = 0; // of the current loop() call
+    // current sampling window
+    unsigned long windowStartUs = 0;
+
+    // admission control, caller of the helpers must own schedMux
+    AdmissionConfig admissionConfig;
+    bool admissionEnabled = false;
+    uint32_t taskCostUs(const Task& t) const;
+    // sum of cost / interval over the repeating tasks in parts per million, kept up to
+    // date by updateLoad() whenever a task's cost or interval changes or it is added/erased
+    uint64_t repeatingLoadPpm = 0;
+    void updateLoad(Task& t);
+    uint32_t projectedLoadPpm(PID_t exclude) const;
+    // may stretch t.interval; t.PID (if already in the list) counts with t's values only
+    AddStatus admit(Task& t) const;
+
+    // retry tasks: one attempt, then done, re-armed with the backoff or failed for good
+    void retryAttempt(PID_t pid, const std::function<bool()>& attempt, const RetryPolicy& policy);
+    uint32_t jitterState = 0; // xorshift32 for the retry jitter, seeded on first use
+    uint32_t windowBusyUs = 0;
+    uint32_t windowMaxLatenessMs = 0;
+
+    // record/replay hook; all scheduling time reads go through clockMs()/clockUs()
+    // (the watchdog keeps reading the live clock)
+#if SCHEDULER_TAP
+    SchedulerTap* tap = nullptr;
+    uint32_t clockMs() const { return tap ? tap->clock(false, millis()) : millis(); }
+    uint32_t clockUs() const { return tap ? tap->clock(true, micros()) : micros(); }
+    void tapSubmitted(uint8_t kind, PID_t pid, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        if (tap && (pid || kind == SchedulerTap::SUBMIT_HOLD)) tap->submitted(kind, pid, a, b, c);
+    }
+    struct TapLoopScope {
+        SchedulerTap* t;
+        explicit TapLoopScope(SchedulerTap* tap) : t(tap) { if (t) t->loopBegin(); }
+        ~TapLoopScope() { if (t) t->loopEnd(); }
+    };
+    bool conditionOutcome(Task& t) { return tap ? tap->condition(t.PID, t.condition) : t.conditionTrue(); }
+    bool chunkOutcome(PID_t pid, const std::function<bool()>& run) { return tap ? tap->condition(pid, run) : run(); }
+#else
+    uint32_t clockMs() const { return millis(); }
+    uint32_t clockUs() const { return micros(); }
+    void tapSubmitted(uint8_t, PID_t, uint32_t = 0, uint32_t = 0, uint32_t = 0) {}
+    bool conditionOutcome(Task& t) { return t.conditionTrue(); }
+    bool chunkOutcome(PID_t, const std::function<bool()>& run) { return run(); }
+#endif
+
+    // runs at every exit of loop() once it got past the early returns
+    struct LoopTimer {
+        Scheduler& s;
+        unsigned long startUs;
+        explicit LoopTimer(Scheduler& sched) : s(sched), startUs(sched.clockUs()) {
+            s.loopMaxLatenessMs = 0;
+            s.loopBackgroundUs = 0;
+            s.loopDidWork = false;
+        }
+        ~LoopTimer() { s.endOfLoop(startUs); }
+    };
+    void endOfLoop(unsigned long startUs);
+
+    // metrics counters, only written by loop()
+    struct MetricCounters {
+        unsigned long startMs = 0;
+        uint32_t loopCalls = 0;
+        uint32_t workCalls = 0;
+        uint32_t wakeups = 0;
+        uint32_t dispatched = 0;
+        uint32_t conditionEvals = 0;
+        uint32_t timeouts = 0;
+        uint64_t busyUs = 0;
+        uint64_t backgroundUs = 0;
+        uint32_t maxLatenessMs = 0;
+    };
+    MetricCounters counters;
+    bool loopDidWork = false;
+    bool lastLoopDidWork = false;
+
+    // loop() call gap monitor
+    unsigned long lastLoopCallUs = 0;
+    LoopGapStats gapStats = LoopGapStats();
+    uint32_t starvationThresholdUs = 0;
+    std::function<void(uint32_t)> onStarvation;
+    void recordLoopGap();
+
+#if SCHEDULER_WATCHDOG
+    // execution watchdog: the callback in progress, read by checkWatchdog() from
+    // an ISR or another thread. wdStage is written last when publishing.
+    volatile PID_t wdPID = 0;
+    volatile uint8_t wdStage = STAGE_NONE;
+    volatile uint32_t wdStartUs = 0;
+    volatile uint32_t wdBudgetUs = 0;
+    volatile bool wdTripped = false;
+    bool watchdogEnabled = false;
+    uint32_t watchdogDefaultBudgetUs = 0;
+    void (*watchdogHook)(const SchedulerCrashRecord&) = nullptr;
+    uint32_t watchdogOverruns = 0;
+    volatile uint32_t watchdogTrips = 0;
+#endif
+
+    // every callback starts here: counts it for metrics() and publishes it to the watchdog
+    void stageBegin(PID_t pid, uint8_t stage, uint32_t taskBudgetUs) {
+        if (stage == STAGE_CONDITION) {
+            counters.conditionEvals++;
+        } else if (stage != STAGE_BACKGROUND) {
+            if (stage == STAGE_EXECUTE) counters.dispatched++;
+            else counters.timeouts++;
+            loopDidWork = true;
+        }
+#if SCHEDULER_WATCHDOG
+        if (!watchdogEnabled) return;
+        wdPID = pid;
+        wdBudgetUs = taskBudgetUs ? taskBudgetUs : watchdogDefaultBudgetUs;
+        wdTripped = false;
+        wdStartUs = micros();
+        wdStage = stage;
+#else
+        (void)pid;
+        (void)taskBudgetUs;
+#endif
+    }
+    // returns true if the callback took longer than its budget
+    bool stageEnd() {
+#if SCHEDULER_WATCHDOG
+        if (!watchdogEnabled) return false;
+        wdStage = STAGE_NONE;
+        const bool over = wdBudgetUs && (uint32_t)(micros() - wdStartUs) > wdBudgetUs;
+        if (over) watchdogOverruns++;
+        return over;
+#else
+        return false;
+#endif
+    }
+    // evaluate a condition under the watchdog
+    bool evaluateCondition(Task& t) {
+#if SCHEDULER_PROFILING
+        const unsigned long profStart = profileWindowMs ? clockUs() : 0;
+#endif
+        stageBegin(t.PID, STAGE_CONDITION, t.budgetUs);
+        const bool met = conditionOutcome(t);
+        if (stageEnd()) t.overruns++;
+#if SCHEDULER_PROFILING
+        if (profileWindowMs) profileWindow(t).conditionUs += clockUs() - profStart;
+#endif
+        return met;
+    }
+
+#if SCHEDULER_PROFILING
+    // windowed task profile, 0 => off. Windows are counted from profileStartMs,
+    // a task's counters roll over lazily when it is next accounted.
+    uint32_t profileWindowMs = 0;
+    uint32_t profileStartMs = 0;
+    uint32_t profileEpoch = 0; // window of the current loop() call
+    Task::ProfileWindow& profileWindow(Task& t) {
+        if (t.profEpoch != profileEpoch) {
+            t.profPrev = t.profEpoch + 1 == profileEpoch ? t.profCur : Task::ProfileWindow();
+            t.profCur = Task::ProfileWindow();
+            t.profEpoch = profileEpoch;
+        }
+        return t.profCur;
+    }
+#endif
 
      // can be private now with changes to stop
     void clear() { 
         MuxGuard lock(&schedMux); 
         tasks.clear(); 
+        repeatingLoadPpm = 0;
+        timeoutHeap.clear();
+        resetFutureSlots();
+        futureResetPending = false;
+        background.clear();
+#if SCHEDULER_INDEXED
+        pidIndex.clear();
+        execHeap.clear();
+        toArm.clear();
+        waiting.clear();
+        children.clear();
+#endif
     }
 
     void clearMarkedForRemoval(bool alreadyLocked=true);
@@ -108,6 +673,9 @@ private:
     PID_t nextPID = 1;
     PID_t getAndIncrementPID();
 
+    uint32_t timeToNextOwnTask(std::vector<Scheduler*>& kids) const;
+    bool hasDescendant(const Scheduler* s) const;
+
     bool onHold = false;
     bool inLoop = false;
 
@@ -115,22 +683,25 @@ private:
 
     
     
-    std::function<void()> getTaskActionByPID(PID_t pid) {
+    std::function<void()> getTaskActionByPID(PID_t pid, uint32_t* budgetUs = nullptr) {
         //
         MuxGuard lock(&schedMux);
-        auto it = std::find_if(tasks.begin(), tasks.end(),
-                               [pid](const Task& tk){ return tk.PID == pid; });
-        if (it != tasks.end()) {
+        Task* it = findTask(pid);
+        if (it) {
+            // a signalled task is dormant again once it runs,
+            // so a signal from within its own onExecute re-arms it
+            if (it->signalled) it->conditionMet = false;
+            if (budgetUs) *budgetUs = it->budgetUs;
             return it->onExecute;
         }
         return std::function<void()>{}; // not found
     }
 
-    std::function<void(PID_t)> getTaskTimeoutByPID(PID_t pid) {
+    std::function<void(PID_t)> getTaskTimeoutByPID(PID_t pid, uint32_t* budgetUs = nullptr) {
         MuxGuard lock(&schedMux);
-        auto it = std::find_if(tasks.begin(), tasks.end(),
-                               [pid](const Task& tk){ return tk.PID == pid; });
-        if (it != tasks.end()) {
+        Task* it = findTask(pid);
+        if (it) {
+            if (budgetUs) *budgetUs = it->budgetUs;
             return it->onTimeout;
         }
         return std::function<void(PID_t)>{}; // not found
@@ -140,9 +711,8 @@ private:
         Task t;
         success = false;
         MuxGuard lock(&schedMux, !locked);
-        auto it = std::find_if(tasks.begin(), tasks.end(),
-                               [pid](const Task& tk){ return tk.PID == pid; });
-        if (it != tasks.end()) {
+        Task* it = findTask(pid);
+        if (it) {
             t = *it; // copy the task
             success = true;
         }
@@ -151,9 +721,8 @@ private:
 
     bool modifyTaskByPID(PID_t pid, const Task& newTask, bool locked = true) {
         MuxGuard lock(&schedMux, !locked);
-        auto it = std::find_if(tasks.begin(), tasks.end(),
-                               [pid](const Task& tk){ return tk.PID == pid; });
-        if (it != tasks.end()) {
+        Task* it = findTask(pid);
+        if (it) {
             *it = newTask; // modify the task
             return true;
         }
@@ -162,14 +731,36 @@ private:
 
     //never locked! Caller must own schedMux; pointer valid only until lock released.
     Task * getTaskByPID(PID_t pid) {
-        auto it = std::find_if(tasks.begin(), tasks.end(),
-                               [pid](const Task& tk){ return tk.PID == pid; });
-        if (it != tasks.end()) {
-            return &(*it); // return pointer to the task
-        }
-        return nullptr; // not found
+        return findTask(pid);
     }
 
+    // Future<T> result storage, see SCHEDULER_FUTURE_SLOTS
+    struct FutureSlot {
+        alignas(8) uint8_t storage[SCHEDULER_FUTURE_SLOT_SIZE];
+        void (*destroy)(void*) = nullptr; // destructor of the held value, if ready
+        uint16_t generation = 0;          // invalidates handles to a released slot
+        bool used = false;
+        bool ready = false;
+        PID_t continuation = 0;           // signalled task armed once the result is set
+        bool stopped = false;             // in use at stop(), reset at the next loop()
+    };
+    FutureSlot futureSlots[SCHEDULER_FUTURE_SLOTS];
+
+    template<typename T> friend class Future;
+
+    template<typename T> static void destroyFutureValue(void* p) { static_cast<T*>(p)->~T(); }
+
+    // returns false if all slots are in use
+    bool allocFutureSlot(uint8_t& slot, uint16_t& generation);
+    void releaseFutureSlot(uint8_t slot, uint16_t generation);
+    void resetFutureSlots(bool stoppedOnly = false);
+    bool futureReady(uint8_t slot, uint16_t generation) const;
+    // pointer into the slot, nullptr if the handle is stale or the result not set yet
+    void* futureValue(uint8_t slot, uint16_t generation);
+    // arms the continuation right away if the result is already there
+    bool setFutureContinuation(uint8_t slot, uint16_t generation, PID_t pid);
+    template<typename T> void setFutureResult(uint8_t slot, uint16_t generation, T&& value);
+
 public:
     // Constructor
     Scheduler();
@@ -180,18 +771,92 @@ public:
     }
 
     // Switch modes
+#if SCHEDULER_SEQUENTIAL
     void setAndStartSequentialMode(bool seq);
+#endif
     bool isSequentialMode() const { return sequentialMode; }
 
     // The main update function
     void loop();
 
     //returns a maximum of 60s. If not all tasks are initialised, returns 0
-    //otherwise returns time to next task in ms
+    //otherwise returns time to next task in ms. While held, the maximum
     uint32_t timeToNextTask() const;
 
-    void hold(){onHold = true;}
-    void resume(){onHold = false;}
+    // Limit condition evaluations per loop() to maxEvaluations and/or maxMicros (0 => unlimited).
+    // Pending conditions are visited round-robin, so every task gets its turn.
+    // Conditions whose timeout has passed are always evaluated, so timeouts stay exact.
+    void setConditionBudget(uint16_t maxEvaluations, uint32_t maxMicros = 0);
+    // Evaluate a condition regardless of the budget once it was not checked for stalenessMs (0 => off)
+    void setConditionStaleness(uint32_t stalenessMs) { conditionStalenessMs = stalenessMs; }
+
+    // With polling (default) a pending condition without timeout makes timeToNextTask() 0,
+    // so the caller keeps calling loop(). Without, conditions are evaluated whenever loop()
+    // runs for another reason; call notifyConditions() when their inputs change.
+    void setConditionPolling(bool poll) { conditionPolling = poll; }
+    void notifyConditions() { wake(); }
+
+    // hook(context) is called after a submission (add*, signalTask(), notifyConditions(),
+    // setRepeatingTaskInterval(), resume()) that may need loop() before timeToNextTask()
+    // said, e.g. to wake an event loop (tools/SchedulerFd.h). signalTask() may call it from
+    // an ISR or another thread. nullptr => off
+    void setWakeHook(void (*hook)(void*), void* context) {
+        MuxGuard lock(&schedMux);
+        wakeHook = hook;
+        wakeContext = context;
+    }
+
+    // Enable overload management, onChange(true/false) is called when entering/leaving overload
+    void setOverloadManagement(const OverloadConfig& config, std::function<void(bool)> onChange = nullptr);
+    void disableOverloadManagement();
+    OverloadStatus overloadStatus() const;
+
+    // Check new repeating tasks against a utilization budget, see AdmissionConfig.
+    // Walks the task list on every repeating add while enabled.
+    void setAdmissionControl(const AdmissionConfig& config);
+    void disableAdmissionControl();
+    // projected utilization of the repeating tasks, as admission control computes it
+    uint16_t projectedUtilPermille() const;
+
+#if SCHEDULER_TAP
+    // Route clock reads, condition outcomes and submissions through tap (nullptr => off).
+    // Set it before adding tasks so a recording covers the whole session.
+    void setTap(SchedulerTap* t) { tap = t; }
+#endif
+
+    // Snapshot of the runtime metrics, rates are averages since resetMetrics() (or construction)
+    Metrics metrics() const;
+    void resetMetrics();
+
+    // Call onStarved(gapMs) from loop() when it was not called for more than thresholdMs
+    // (0 => no callback). The gap histogram is recorded regardless.
+    void setStarvationMonitor(uint32_t thresholdMs, std::function<void(uint32_t)> onStarved = nullptr);
+    LoopGapStats loopGapStats() const;
+    void resetLoopGapStats();
+    // upper bound of a histogram bucket in ms, 0 for the open last bucket
+    static uint32_t loopGapBucketLimitMs(uint8_t bucket) {
+        return bucket + 1 < SCHEDULER_LOOP_GAP_BUCKETS ? (1UL << bucket) : 0;
+    }
+
+#if SCHEDULER_WATCHDOG
+    // Execution watchdog: every condition, onExecute and onTimeout is timestamped when it
+    // starts. checkWatchdog() must be called periodically from a timer ISR, the other core
+    // or a separate thread on host (conditions run inside the scheduler lock, which masks
+    // interrupts on this core). When a callback exceeds its budget it writes the crash
+    // record and calls hook from that context, so hook must be ISR safe.
+    void enableWatchdog(uint32_t defaultBudgetUs, void (*hook)(const SchedulerCrashRecord&) = nullptr);
+    void disableWatchdog() { watchdogEnabled = false; wdStage = STAGE_NONE; }
+    // Returns true if a callback in progress just exceeded its budget
+    bool checkWatchdog();
+    uint32_t watchdogOverrunCount() const { return watchdogOverruns; } // finished over budget
+    uint32_t watchdogTripCount() const { return watchdogTrips; }       // caught while running
+    // Crash record of the last trip, also after a reset. Returns false if there is none
+    static bool lastCrashRecord(SchedulerCrashRecord& out);
+    static void clearCrashRecord();
+#endif
+
+    void hold(){onHold = true; tapSubmitted(SchedulerTap::SUBMIT_HOLD, 0, 1);}
+    void resume(){onHold = false; tapSubmitted(SchedulerTap::SUBMIT_HOLD, 0, 0); wake();}
 
     // could be extended by tracking PIDs here instead of size
     void stop();
@@ -203,10 +868,14 @@ public:
     //    user gives "delayMs" => that is your postConditionDelay
     //    If repeat is true, interval is how often it repeats (in parallel).
     //    Also, if repeat is true and no interval is given, it defaults to delayMs.
+    //    costUs declares the execution time for admission control (0 => unknown),
+    //    status (optional) receives why 0 was returned, or ADD_DEGRADED.
     PID_t addTimedTask(std::function<void()> onExecute,
                       uint32_t delayMs,
                       bool repeat = false,
-                      uint32_t interval = 0);
+                      uint32_t interval = 0,
+                      uint32_t costUs = 0,
+                      AddStatus* status = nullptr);
 
     // 2) "Conditional" => must become true within conditionWait
     //    In sequential mode, conditionWaitMs is w.r.t. 
@@ -231,6 +900,65 @@ public:
                                  uint32_t conditionWaitMs = 0,
                                  std::function<void(PID_t)> onTimeout = nullptr);
 
+    // 4) "Signalled" => no condition is polled, the task stays dormant until
+    //    signalTask() arms it. If persistent, it returns to dormant after each run
+    //    and keeps its PID, otherwise it is removed once it ran.
+    //    A one-shot task with timeoutMs > 0 that is not signalled within timeoutMs
+    //    is removed and onTimeout called, like a conditional task timing out.
+    //    Not supported in sequential mode.
+    PID_t addSignalledTask(std::function<void()> onExecute, bool persistent = false,
+                           uint32_t timeoutMs = 0,
+                           std::function<void(PID_t)> onTimeout = nullptr);
+
+    // 5) "Future" => like addTimedTask, but produce() returns a value that is stored
+    //    in a scheduler owned result slot. The returned handle is invalid if no slot
+    //    or task was available. Result types must fit SCHEDULER_FUTURE_SLOT_SIZE.
+    template<typename F>
+    Future<decltype(std::declval<F&>()())> addFutureTask(F produce, uint32_t delayMs = 0);
+
+    // 6) "Child scheduler" => child.loop() is dispatched from this scheduler's loop()
+    //    only when the child's earliest deadline is due, and this scheduler's
+    //    timeToNextTask() includes the child's. The child keeps its own tasks and lock
+    //    and must outlive the registration; remove it with removeTask().
+    //    A child that (indirectly) contains this scheduler is rejected (PID 0).
+    //    Not supported in sequential mode.
+    PID_t addChildScheduler(Scheduler& child);
+
+    // 7) "Background" => chunk(slice) runs only in spare time: at the end of loop(), when
+    //    nothing is due and timeToNextTask() exceeds the slack (setBackgroundSlack()).
+    //    Each call should do a bounded piece of work and return as soon as
+    //    slice.shouldYield(); true => more to do, called again in a later slice,
+    //    false => done and removed. Background tasks are visited round-robin, the time
+    //    counts as idle in metrics(). Polled conditions without a timeout leave no slack
+    //    (see setConditionPolling()). Not supported in sequential mode.
+    PID_t addBackgroundTask(std::function<bool(BackgroundSlice&)> chunk);
+
+    // Background slices end slackMs before the next foreground deadline and last at
+    // most maxSliceMs (0 => up to the deadline) per loop() call
+    void setBackgroundSlack(uint32_t slackMs, uint32_t maxSliceMs = 10) {
+        MuxGuard lock(&schedMux);
+        backgroundSlackMs = slackMs;
+        backgroundMaxSliceMs = maxSliceMs;
+    }
+    // true if loop() would run background chunks now
+    bool backgroundReady() const;
+
+    // 8) "Retry" => attempt() runs after delayMs; false => it runs again after the next backoff
+    //    of policy, until it returns true or maxAttempts failed, then onFailure(pid) is
+    //    called from loop(). Each attempt re-arms the same persistent signalled task:
+    //    one PID and slot for all attempts, removeTask() cancels the retries.
+    //    Not supported in sequential mode.
+    PID_t addRetryTask(std::function<bool()> attempt, const RetryPolicy& policy,
+                       std::function<void(PID_t)> onFailure = nullptr, uint32_t delayMs = 0);
+
+    // Arm a signalled task to run delayMs from now; arming again moves the deadline.
+    // Can be called from within callbacks. Returns false if pid is not a signalled task
+    // (or a background task).
+    bool signalTask(PID_t pid, uint32_t delayMs = 0);
+
+    // Return an armed signalled task to dormant without running it
+    bool disarmTask(PID_t pid);
+
     // ----------------------------------------------------
     // Public Task Manipulation Methods (restricted to a few)
     // These can only be executed outside of the loop
@@ -240,10 +968,226 @@ public:
     // Returns true if the task was found and removed
     bool removeTask(PID_t pid);
 
+    // Bind a task to a token bucket (nullptr unbinds). Each run takes one token and the
+    // task is not due while the bucket is empty. The bucket must outlive the binding.
+    // Returns true if the task was found. Not supported in sequential mode (false)
+    bool bindRateLimiter(PID_t pid, TokenBucket* bucket);
+
+#if SCHEDULER_WATCHDOG
+    // Per-task watchdog budget for each callback stage (0 => default budget)
+    // Returns true if the task was found
+    bool setTaskBudget(PID_t pid, uint32_t budgetUs);
+#endif
+
+    // Set the priority used for load shedding (PRIORITY_NORMAL by default)
+    // Returns true if the task was found
+    bool setTaskPriority(PID_t pid, uint8_t priority);
+
+    // Append the repeating tasks in task order, with their interval and measured
+    // worst-case execution time, for analyzeSchedule(). That is the dispatch order
+    // unless SCHEDULER_INDEXED, which dispatches in deadline order (analyzeSchedule(
+    // ..., deadlineOrder = SCHEDULER_INDEXED))
+    size_t collectPeriodicTasks(std::vector<AnalysisTask>& out) const;
+
+    // The next n deadlines in time order into out, not capped like timeToNextTask().
+    // Covers armed and not yet armed timed tasks (including the wait for a rate limiter
+    // token), finite condition timeouts and child schedulers (their earliest deadline);
+    // dormant signalled tasks and conditions without a timeout have no deadline. The
+    // task list is walked tasksPerLock tasks per lock, keeping a heap of n entries:
+    // O(tasks * log n). Tasks added or removed between two locks may be skipped or
+    // reported twice. Indexed builds walk the earliest entries of their deadline heaps
+    // in place under one lock instead: O(n log n) plus stale entries met on the way,
+    // plus the tasks waiting to be armed. Returns the number of entries filled.
+    size_t upcomingDeadlines(UpcomingDeadline* out, size_t n, size_t tasksPerLock = 16) const;
+
+#if SCHEDULER_PROFILING
+    // Per-task profile over a sliding window of windowMs (0 => off), accounted
+    // incrementally: each task keeps the current and the previous window, and the
+    // previous one is weighted by how much of it still lies inside the sliding window.
+    void enableProfiling(uint32_t windowMs);
+    uint32_t profilingWindow() const { return profileWindowMs; }
+    // The n tasks with the highest key value, sorted, into out. Returns the number filled.
+    // Walks the task list one task per lock, the task list itself is never sorted.
+    size_t profileTop(ProfileEntry* out, size_t n, ProfileKey key) const;
+#endif
+
+    // Counters of the task at position index (0 .. taskCount()-1), false past the end.
+    // Locks once per call, so the task list can be walked without copying it.
+    bool taskStats(size_t index, TaskStats& out) const;
+
     // Adapt a task repeat interval by PID
-    // Returns true if the task was found, is a repeating task, and was updated
-    bool setRepeatingTaskInterval(PID_t pid, uint32_t interval);
+    // Returns true if the task was found, is a repeating task, and was updated.
+    // Admission control applies as for a new task: the interval may be stretched
+    // (status ADD_DEGRADED) or the change rejected (ADD_REJECTED_LOAD, returns false)
+    bool setRepeatingTaskInterval(PID_t pid, uint32_t interval, AddStatus* status = nullptr);
+
+};
+
+/*
+  Handle to the result of an addFutureTask() or then() step.
+  It is just (scheduler, slot, generation) and move-only: the value itself
+  lives in the Scheduler's result slots until it is taken, released,
+  or consumed by a continuation, and a handle releases its slot when destroyed.
+  So keep the handle as long as the result is wanted; it must not outlive the
+  scheduler. Handles to a released slot read as not ready, as do those in use
+  at stop() once the next loop() has reset their slots.
+*/
+template<typename T>
+class Future {
+public:
+    Future() {}
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+    Future(Future&& other) : sched(other.sched), slot(other.slot), generation(other.generation) {
+        other.sched = nullptr;
+    }
+    Future& operator=(Future&& other) {
+        if (this != &other) {
+            release();
+            sched = other.sched;
+            slot = other.slot;
+            generation = other.generation;
+            other.sched = nullptr;
+        }
+        return *this;
+    }
+    ~Future() { release(); }
+
+    bool valid() const { return sched != nullptr; }
+    bool ready() const { return sched && sched->futureReady(slot, generation); }
+
+    // Pointer to the result in the slot, nullptr while not ready
+    T* value() const {
+        return sched ? static_cast<T*>(sched->futureValue(slot, generation)) : nullptr;
+    }
+
+    // Move the result out and release the slot. Returns false if not ready
+    bool take(T& out) {
+        T* v = value();
+        if (!v) return false;
+        out = std::move(*v);
+        release();
+        return true;
+    }
+
+    // Give up the result slot, also if the result never arrived
+    void release() {
+        if (sched) sched->releaseFutureSlot(slot, generation);
+        sched = nullptr;
+    }
+
+    // Run f(T&) once the result is set. The continuation is a signalled task armed
+    // by setting the result, nothing is polled. The input slot is released after f ran
+    // and this handle is consumed. f's return value goes into the returned future;
+    // for a void f the PID of the continuation task is returned instead (0 on failure).
+    template<typename F, typename U = decltype(std::declval<F&>()(std::declval<T&>()))>
+    typename std::enable_if<!std::is_void<U>::value, Future<U>>::type then(F f);
 
+    template<typename F, typename U = decltype(std::declval<F&>()(std::declval<T&>()))>
+    typename std::enable_if<std::is_void<U>::value, PID_t>::type then(F f);
+
+private:
+    friend class Scheduler;
+    template<typename U> friend class Future;
+
+    Future(Scheduler* s, uint8_t sl, uint16_t gen) : sched(s), slot(sl), generation(gen) {}
+
+    Scheduler* sched = nullptr;
+    uint8_t slot = 0;
+    uint16_t generation = 0;
 };
 
-#endif
\ No newline at end of file
+template<typename T>
+void Scheduler::setFutureResult(uint8_t slot, uint16_t generation, T&& value) {
+    PID_t cont = 0;
+    {
+        MuxGuard lock(&schedMux);
+        FutureSlot& fs = futureSlots[slot];
+        if (!fs.used || fs.ready || fs.generation != generation) return; // released meanwhile
+        new (fs.storage) T(std::move(value));
+        fs.destroy = &destroyFutureValue<T>;
+        fs.ready = true;
+        cont = fs.continuation;
+    }
+    if (cont) signalTask(cont);
+}
+
+template<typename F>
+Future<decltype(std::declval<F&>()())> Scheduler::addFutureTask(F produce, uint32_t delayMs) {
+    typedef decltype(std::declval<F&>()()) T;
+    static_assert(!std::is_void<T>::value && !std::is_reference<T>::value,
+                  "addFutureTask needs a callable returning a value");
+    static_assert(sizeof(T) <= SCHEDULER_FUTURE_SLOT_SIZE, "Result type too large, raise SCHEDULER_FUTURE_SLOT_SIZE");
+    static_assert(alignof(T) <= 8, "Result type alignment not supported");
+
+    uint8_t slot;
+    uint16_t generation;
+    if (!allocFutureSlot(slot, generation)) return Future<T>();
+
+    PID_t pid = addTimedTask([this, slot, generation, produce]() mutable {
+        setFutureResult<T>(slot, generation, produce());
+    }, delayMs);
+    if (!pid) {
+        releaseFutureSlot(slot, generation);
+        return Future<T>();
+    }
+    return Future<T>(this, slot, generation);
+}
+
+template<typename T>
+template<typename F, typename U>
+typename std::enable_if<!std::is_void<U>::value, Future<U>>::type Future<T>::then(F f) {
+    static_assert(!std::is_reference<U>::value, "then() continuation must return a value");
+    static_assert(sizeof(U) <= SCHEDULER_FUTURE_SLOT_SIZE, "Result type too large, raise SCHEDULER_FUTURE_SLOT_SIZE");
+    static_assert(alignof(U) <= 8, "Result type alignment not supported");
+
+    Scheduler* s = sched;
+    if (!s) return Future<U>();
+    uint8_t outSlot;
+    uint16_t outGen;
+    if (!s->allocFutureSlot(outSlot, outGen)) return Future<U>();
+
+    const uint8_t inSlot = slot;
+    const uint16_t inGen = generation;
+    PID_t pid = s->addSignalledTask([s, inSlot, inGen, outSlot, outGen, f]() mutable {
+        T* v = static_cast<T*>(s->futureValue(inSlot, inGen));
+        if (!v) { // input released meanwhile
+            s->releaseFutureSlot(outSlot, outGen);
+            return;
+        }
+        U r = f(*v);
+        s->releaseFutureSlot(inSlot, inGen);
+        s->setFutureResult<U>(outSlot, outGen, std::move(r));
+    });
+    if (!pid || !s->setFutureContinuation(inSlot, inGen, pid)) {
+        if (pid) s->removeTask(pid);
+        s->releaseFutureSlot(outSlot, outGen);
+        return Future<U>();
+    }
+    sched = nullptr; // the continuation owns the input slot now
+    return Future<U>(s, outSlot, outGen);
+}
+
+template<typename T>
+template<typename F, typename U>
+typename std::enable_if<std::is_void<U>::value, PID_t>::type Future<T>::then(F f) {
+    Scheduler* s = sched;
+    if (!s) return 0;
+
+    const uint8_t inSlot = slot;
+    const uint16_t inGen = generation;
+    PID_t pid = s->addSignalledTask([s, inSlot, inGen, f]() mutable {
+        T* v = static_cast<T*>(s->futureValue(inSlot, inGen));
+        if (!v) return; // input released meanwhile
+        f(*v);
+        s->releaseFutureSlot(inSlot, inGen);
+    });
+    if (!pid || !s->setFutureContinuation(inSlot, inGen, pid)) {
+        if (pid) s->removeTask(pid);
+        return 0;
+    }
+    sched = nullptr; // the continuation owns the input slot now
+    return pid;
+}
+
+#endif
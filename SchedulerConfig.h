@@ -0,0 +1,64 @@
+// SchedulerConfig.h
+#pragma once
+
+/*
+  Compile-time feature selection for Scheduler. Define a flag as 0 (build flags,
+  e.g. -DSCHEDULER_SEQUENTIAL=0, or before including Scheduler.h everywhere) to
+  strip the feature: its code, its members and its per-loop() work are gone and
+  its API is not declared.
+*/
+
+// setAndStartSequentialMode() and the sequential branch of loop()
+#ifndef SCHEDULER_SEQUENTIAL
+#define SCHEDULER_SEQUENTIAL 1
+#endif
+
+// stop() from within onExecute cancels the rest of the current loop() call.
+// With 0 stop() still works, but from a callback it takes effect at the next loop().
+#ifndef SCHEDULER_STOP_IN_CALLBACK
+#define SCHEDULER_STOP_IN_CALLBACK 1
+#endif
+
+// execution watchdog: enableWatchdog(), checkWatchdog(), crash record, task budgets
+#ifndef SCHEDULER_WATCHDOG
+#define SCHEDULER_WATCHDOG 1
+#endif
+
+// windowed task profile: enableProfiling(), profileTop(), ProfileReport.h
+#ifndef SCHEDULER_PROFILING
+#define SCHEDULER_PROFILING 1
+#endif
+
+// record/replay hook: setTap(), SessionRecorder.h
+#ifndef SCHEDULER_TAP
+#define SCHEDULER_TAP 1
+#endif
+
+// log every dispatched task (was HIGHLY_VERBOSE)
+#ifndef SCHEDULER_VERBOSE
+#ifdef HIGHLY_VERBOSE
+#define SCHEDULER_VERBOSE 1
+#else
+#define SCHEDULER_VERBOSE 0
+#endif
+#endif
+
+// Capacity. PID_t must hold more values than SCHEDULER_MAX_TASKS (PID 0 is never used).
+// For large task sets on a host build e.g. -DSCHEDULER_PID_TYPE=uint32_t
+// -DSCHEDULER_MAX_TASKS=1000000 -DSCHEDULER_INDEXED=1 -DSCHEDULER_SEQUENTIAL=0
+#ifndef SCHEDULER_PID_TYPE
+#define SCHEDULER_PID_TYPE uint16_t
+#endif
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 124
+#endif
+
+// Indexed task list: a PID index and an execution deadline heap instead of scanning
+// the task list, so add, remove, lookup, timeToNextTask() and dispatch of timed and
+// signalled tasks cost O(1) to O(log n) instead of O(n). Conditions are still polled,
+// O(conditional tasks) per loop(). Due tasks are dispatched in deadline order instead
+// of list order, and removal does not keep the list order. Costs RAM per task and heap
+// allocations, meant for large task sets on a host; not with SCHEDULER_SEQUENTIAL.
+#ifndef SCHEDULER_INDEXED
+#define SCHEDULER_INDEXED 0
+#endif
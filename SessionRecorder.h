@@ -0,0 +1,166 @@
+// SessionRecorder.h
+#pragma once
+#include <Arduino.h>
+#include "Scheduler.h"
+
+#if !SCHEDULER_TAP
+#error "SessionRecorder.h needs SCHEDULER_TAP"
+#endif
+
+/*
+  Records the inputs of a Scheduler session so it can be replayed on the host
+  (tools/SessionReplay.h, tools/schedreplay.cpp) against another engine version.
+
+  Logged are the loop() boundaries, every scheduling clock read (delta coded),
+  every condition outcome and the submissions (add / signal / disarm / remove
+  of timed, conditional, signalled and background tasks, interval and priority
+  changes, hold() / resume()). Task bodies are not recorded; the replay runs no-op
+  or host supplied bodies. A background chunk is logged like a condition: its
+  result (more to do or not) and the clock reads it made.
+
+  Events go into a RAM buffer of N bytes, which is written to the sink (anything
+  with size_t write(const uint8_t*, size_t)) at the end of every loop() and by
+  flush(). Nothing is written while the scheduler lock is held. If the buffer
+  fills up within one loop() further events are dropped and an OVERFLOW event
+  marks the gap; such a log does not replay exactly.
+
+  Not supported while recording: signalTask() from an ISR or another thread,
+  child schedulers (their sessions are not recorded), bindRateLimiter() (the
+  bucket's state lives outside the scheduler; the replay runs unlimited).
+
+  Stream format: 'S' 'R' <version 1> <varint ms> <varint us>, then events
+  <type byte> [unsigned LEB128 varints], types below.
+*/
+namespace SessionLog {
+    enum Event : uint8_t {
+        END          = 0x00,
+        LOOP_BEGIN   = 0x01,
+        LOOP_END     = 0x02,
+        CLOCK_MS     = 0x03, // delta to the previous ms read
+        CLOCK_US     = 0x04, // delta to the previous us read
+        COND_FALSE   = 0x05, // pid
+        COND_TRUE    = 0x06, // pid; for a background chunk: more to do
+        // 0x10.. SchedulerTap::Submission: pid a b c
+        OVERFLOW     = 0x7F  // number of dropped events
+    };
+    const uint8_t VERSION = 1;
+}
+
+template<typename Sink = Print, size_t N = 256>
+class SessionRecorder : public SchedulerTap {
+public:
+    explicit SessionRecorder(Sink& out) : sink(out) {}
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+    ~SessionRecorder() { end(); }
+
+    // Write the header and attach to sched
+    void begin(Scheduler& sched) {
+        end();
+        scheduler = &sched;
+        lastMs = millis();
+        lastUs = micros();
+        uint8_t header[3 + 10];
+        header[0] = 'S';
+        header[1] = 'R';
+        header[2] = SessionLog::VERSION;
+        size_t n = 3;
+        n = varint(header, n, lastMs);
+        n = varint(header, n, lastUs);
+        sink.write(header, n);
+        sched.setTap(this);
+    }
+
+    // Detach, flush and terminate the stream
+    void end() {
+        if (!scheduler) return;
+        scheduler->setTap(nullptr);
+        scheduler = nullptr;
+        put(SessionLog::END);
+        flush();
+    }
+
+    // Write out the buffered events; call from outside loop() if recording between loops
+    void flush() {
+        if (!fill) return;
+        sink.write(buf, fill);
+        fill = 0;
+    }
+
+    uint32_t dropped() const { return droppedEvents; }
+
+    void loopBegin() override { put(SessionLog::LOOP_BEGIN); }
+    void loopEnd() override {
+        put(SessionLog::LOOP_END);
+        flush();
+    }
+    uint32_t clock(bool micro, uint32_t live) override {
+        uint32_t& last = micro ? lastUs : lastMs;
+        put(micro ? SessionLog::CLOCK_US : SessionLog::CLOCK_MS, live - last);
+        last = live;
+        return live;
+    }
+    bool condition(PID_t pid, const std::function<bool()>& live) override {
+        const bool met = live && live();
+        put(met ? SessionLog::COND_TRUE : SessionLog::COND_FALSE, pid);
+        return met;
+    }
+    void submitted(uint8_t kind, PID_t pid, uint32_t a, uint32_t b, uint32_t c) override {
+        uint8_t e[1 + 4 * 5];
+        size_t n = 0;
+        e[n++] = kind;
+        n = varint(e, n, pid);
+        n = varint(e, n, a);
+        n = varint(e, n, b);
+        n = varint(e, n, c);
+        append(e, n);
+    }
+
+private:
+    // unsigned LEB128 into p, returns the new write position
+    static size_t varint(uint8_t* p, size_t pos, uint32_t v) {
+        while (v >= 0x80) {
+            p[pos++] = (uint8_t)v | 0x80;
+            v >>= 7;
+        }
+        p[pos++] = (uint8_t)v;
+        return pos;
+    }
+
+    // loop markers and END use the reserve, so spans stay intact on overflow
+    void put(uint8_t type) { append(&type, 1, true); }
+    void put(uint8_t type, uint32_t value) {
+        uint8_t e[1 + 5];
+        e[0] = type;
+        append(e, varint(e, 1, value));
+    }
+
+    void append(const uint8_t* e, size_t n, bool marker = false) {
+        const size_t limit = marker ? N : N - RESERVE;
+        if (droppedPending && fill + 6 + n <= limit) {
+            buf[fill] = SessionLog::OVERFLOW;
+            fill = varint(buf, fill + 1, droppedPending);
+            droppedPending = 0;
+        }
+        if (droppedPending || fill + n > limit) {
+            droppedPending++;
+            droppedEvents++;
+            return;
+        }
+        memcpy(buf + fill, e, n);
+        fill += n;
+    }
+
+    // room for an OVERFLOW event plus a marker
+    static const size_t RESERVE = 8;
+    static_assert(N >= 32, "SessionRecorder buffer too small");
+
+    Sink& sink;
+    Scheduler* scheduler = nullptr;
+    uint8_t buf[N];
+    size_t fill = 0;
+    uint32_t lastMs = 0;
+    uint32_t lastUs = 0;
+    uint32_t droppedPending = 0;
+    uint32_t droppedEvents = 0;
+};
@@ -0,0 +1,251 @@
+// StateMachine.h
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include "Scheduler.h"
+
+typedef uint8_t StateId;
+typedef uint8_t EventId;
+static const StateId NO_STATE = 0xFF;
+
+/*
+  Hierarchical state machine hosted by a Scheduler.
+
+   - states have an optional parent, initial child, onEntry/onExit and a timeout
+   - transitions are (from, event) -> to with an optional guard and action;
+     an event is matched on the current state first, then on its ancestors
+   - the machine owns one persistent signalled task for its whole life; a
+     transition re-arms (or disarms) it with the earliest timeout over all active
+     states, each measured from when that state was entered. If several have
+     expired, the outermost one is left
+
+  Events dispatched from within entry/exit/actions are queued and run after the
+  current transition (run to completion). Not thread safe, dispatch from tasks.
+*/
+class StateMachine {
+public:
+    struct State {
+        StateId parent = NO_STATE;
+        StateId initial = NO_STATE; // child entered when this state is the target
+        std::function<void()> onEntry;
+        std::function<void()> onExit;
+        uint32_t timeoutMs = 0;     // 0 => no timeout
+        StateId timeoutTarget = NO_STATE;
+        uint32_t enteredAt = 0;
+    };
+
+    struct Transition {
+        StateId from;
+        EventId event;
+        StateId to;
+        std::function<bool()> guard;  // optional
+        std::function<void()> action; // optional, runs between exit and entry
+    };
+
+    StateMachine() {}
+    StateMachine(const StateMachine&) = delete;
+    StateMachine& operator=(const StateMachine&) = delete;
+
+    // Returns the new state's id, NO_STATE if the parent is unknown or all ids are used
+    StateId addState(StateId parent = NO_STATE,
+                     std::function<void()> onEntry = nullptr,
+                     std::function<void()> onExit = nullptr) {
+        if (states.size() >= NO_STATE || (parent != NO_STATE && parent >= states.size())) return NO_STATE;
+        State s;
+        s.parent = parent;
+        s.onEntry = onEntry;
+        s.onExit = onExit;
+        states.push_back(s);
+        const StateId id = states.size() - 1;
+        if (parent != NO_STATE && states[parent].initial == NO_STATE) states[parent].initial = id;
+        return id;
+    }
+
+    // Child entered when a transition targets the composite state (default: first child added)
+    bool setInitial(StateId parent, StateId child) {
+        if (!valid(parent) || !valid(child) || states[child].parent != parent) return false;
+        states[parent].initial = child;
+        return true;
+    }
+
+    // Leave the state for target timeoutMs after entering it (0 => no timeout)
+    bool setStateTimeout(StateId state, uint32_t timeoutMs, StateId target) {
+        if (!valid(state) || !valid(target)) return false;
+        states[state].timeoutMs = timeoutMs;
+        states[state].timeoutTarget = target;
+        return true;
+    }
+
+    bool addTransition(StateId from, EventId event, StateId to,
+                       std::function<bool()> guard = nullptr,
+                       std::function<void()> action = nullptr) {
+        if (!valid(from) || !valid(to)) return false;
+        transitions.push_back(Transition{from, event, to, guard, action});
+        return true;
+    }
+
+    // Allocates the machine's task slot and enters initial (and its initial children)
+    bool begin(Scheduler& sched, StateId initial) {
+        if (!valid(initial)) return false;
+        end();
+        scheduler = &sched;
+        timeoutPID = sched.addSignalledTask([this]() { onStateTimeout(); }, true);
+        if (!timeoutPID) {
+            scheduler = nullptr;
+            return false;
+        }
+        busy = true;
+        transition(initial, nullptr);
+        drainQueue();
+        return true;
+    }
+
+    void end() {
+        if (scheduler && timeoutPID) scheduler->removeTask(timeoutPID);
+        scheduler = nullptr;
+        timeoutPID = 0;
+        current = NO_STATE;
+        queued = 0;
+    }
+
+    // Fire the first transition for event whose guard passes, searching from the
+    // current state outwards. Returns true if a transition was taken (or queued).
+    bool dispatch(EventId event) {
+        if (current == NO_STATE) return false;
+        if (busy) {
+            if (queued >= MAX_QUEUED) return false;
+            queue[(queueStart + queued++) % MAX_QUEUED] = event;
+            return true;
+        }
+        busy = true;
+        const bool taken = handle(event);
+        drainQueue();
+        return taken;
+    }
+
+    StateId state() const { return current; }
+
+    // true if state is the current state or one of its ancestors
+    bool isIn(StateId state) const {
+        for (StateId s = current; s != NO_STATE; s = states[s].parent) {
+            if (s == state) return true;
+        }
+        return false;
+    }
+
+    uint32_t timeInState() const {
+        return current == NO_STATE ? 0 : millis() - states[current].enteredAt;
+    }
+
+private:
+    static const uint8_t MAX_QUEUED = 4;
+
+    bool valid(StateId s) const { return s < states.size(); }
+
+    // runs the events queued from within callbacks, then leaves the busy state
+    void drainQueue() {
+        while (queued) {
+            const EventId e = queue[queueStart];
+            queueStart = (queueStart + 1) % MAX_QUEUED;
+            queued--;
+            handle(e);
+        }
+        busy = false;
+    }
+
+    bool handle(EventId event) {
+        for (StateId s = current; s != NO_STATE; s = states[s].parent) {
+            for (const Transition& t : transitions) {
+                if (t.from != s || t.event != event) continue;
+                if (t.guard && !t.guard()) continue;
+                transition(t.to, &t.action);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void onStateTimeout() {
+        if (current == NO_STATE) return;
+        // the outermost expired state wins, leaving it leaves its children as well
+        const uint32_t now = millis();
+        StateId expired = NO_STATE;
+        for (StateId s = current; s != NO_STATE; s = states[s].parent) {
+            const State& st = states[s];
+            if (st.timeoutMs && (int32_t)(now - (st.enteredAt + st.timeoutMs)) >= 0) expired = s;
+        }
+        if (expired == NO_STATE) {
+            armTimeout(); // re-armed early
+            return;
+        }
+        busy = true;
+        transition(states[expired].timeoutTarget, nullptr);
+        drainQueue();
+    }
+
+    bool isAncestorOrSelf(StateId ancestor, StateId s) const {
+        for (; s != NO_STATE; s = states[s].parent) {
+            if (s == ancestor) return true;
+        }
+        return false;
+    }
+
+    // Exit up to the common ancestor, run the action, enter down to target and its
+    // initial children. A transition to the current state or one of its ancestors
+    // leaves and re-enters that state.
+    void transition(StateId target, const std::function<void()>* action) {
+        StateId lca = isAncestorOrSelf(target, current) ? states[target].parent : target;
+        while (lca != NO_STATE && !isAncestorOrSelf(lca, current)) lca = states[lca].parent;
+
+        for (StateId s = current; s != lca; s = states[s].parent) {
+            if (states[s].onExit) states[s].onExit();
+        }
+        if (action && *action) (*action)();
+
+        StateId path[NO_STATE];
+        uint8_t depth = 0;
+        for (StateId s = target; s != lca; s = states[s].parent) path[depth++] = s;
+        const uint32_t now = millis();
+        while (depth) {
+            current = path[--depth];
+            states[current].enteredAt = now;
+            if (states[current].onEntry) states[current].onEntry();
+        }
+        while (states[current].initial != NO_STATE) {
+            current = states[current].initial;
+            states[current].enteredAt = now;
+            if (states[current].onEntry) states[current].onEntry();
+        }
+        armTimeout();
+    }
+
+    // re-arming is a few stores on the persistent slot: one signalTask() or disarmTask()
+    void armTimeout() {
+        if (!scheduler) return;
+        const uint32_t now = millis();
+        bool any = false;
+        int32_t earliest = 0;
+        for (StateId s = current; s != NO_STATE; s = states[s].parent) {
+            const State& st = states[s];
+            if (!st.timeoutMs) continue;
+            const int32_t left = (int32_t)(st.enteredAt + st.timeoutMs - now);
+            if (!any || left < earliest) earliest = left;
+            any = true;
+        }
+        if (any) scheduler->signalTask(timeoutPID, earliest > 0 ? earliest : 0);
+        else scheduler->disarmTask(timeoutPID);
+    }
+
+    std::vector<State> states;
+    std::vector<Transition> transitions;
+    StateId current = NO_STATE;
+
+    bool busy = false;
+    EventId queue[MAX_QUEUED];
+    uint8_t queueStart = 0;
+    uint8_t queued = 0;
+
+    Scheduler* scheduler = nullptr;
+    PID_t timeoutPID = 0;
+};
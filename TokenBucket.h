@@ -0,0 +1,73 @@
+// TokenBucket.h
+#pragma once
+#include <Arduino.h>
+
+/*
+  Token bucket rate limiter: holds up to capacity tokens, one token is added
+  every refillMs. Tasks bound with Scheduler::bindRateLimiter() take one token
+  per run and are not due while the bucket is empty; timeToNextTask() accounts
+  for the refill time, so throttled tasks sleep instead of waking up.
+
+  A bucket may be shared by several tasks of the same Scheduler. When bound, it
+  is only touched under the scheduler lock; don't use it from other threads then.
+*/
+class TokenBucket {
+public:
+    TokenBucket(uint16_t capacity, uint32_t refillMs)
+      : capacity(capacity ? capacity : 1),
+        refillMs(refillMs ? refillMs : 1),
+        tokens(this->capacity),
+        lastRefill(millis())
+    {}
+
+    // Take one token if available
+    bool tryTake(uint32_t now) {
+        refill(now);
+        if (!tokens) return false;
+        tokens--;
+        return true;
+    }
+    bool tryTake() { return tryTake(millis()); }
+
+    // Time until a token is available, 0 if there is one now
+    uint32_t msUntilToken(uint32_t now) const {
+        if (tokens) return 0;
+        const uint32_t elapsed = now - lastRefill;
+        return elapsed >= refillMs ? 0 : refillMs - elapsed;
+    }
+
+    // Give back a token taken for a run that did not happen
+    void refund() {
+        if (tokens < capacity) tokens++;
+    }
+
+    uint16_t available(uint32_t now) {
+        refill(now);
+        return tokens;
+    }
+
+    // Refill to capacity, e.g. after a link came back up
+    void reset() {
+        tokens = capacity;
+        lastRefill = millis();
+    }
+
+private:
+    void refill(uint32_t now) {
+        const uint32_t elapsed = now - lastRefill;
+        if (elapsed < refillMs) return;
+        const uint32_t add = elapsed / refillMs;
+        if (tokens + add >= capacity) {
+            tokens = capacity;
+            lastRefill = now;
+        } else {
+            tokens += add;
+            lastRefill += add * refillMs; // keep the fractional progress
+        }
+    }
+
+    const uint16_t capacity;
+    const uint32_t refillMs;
+    uint16_t tokens;
+    uint32_t lastRefill;
+};
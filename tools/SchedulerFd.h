@@ -0,0 +1,206 @@
+// SchedulerFd.h
+#pragma once
+// Host only (Linux): one pollable file descriptor for a Scheduler
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <functional>
+#include <unordered_map>
+#include "Scheduler.h"
+
+/*
+  fd() becomes readable when the scheduler has work: the next deadline from
+  timeToNextTask() is due (timerfd), or a submission, signalTask() or
+  notifyConditions() woke it (eventfd, through the scheduler's wake hook). Put it
+  into the application's epoll/poll set for reading and call dispatch() whenever it
+  is readable; nothing runs in between, no thread, no periodic polling.
+
+      SchedulerFd sfd(sched);
+      epoll_event ev = {}; ev.events = EPOLLIN; ev.data.ptr = &sfd;
+      epoll_ctl(appEpoll, EPOLL_CTL_ADD, sfd.fd(), &ev);
+      ...
+      if (ready.data.ptr == &sfd) sfd.dispatch();
+
+  The descriptor is an epoll instance holding both, so it is level triggered and
+  stays readable until dispatch() ran. The scheduler is switched to
+  setConditionPolling(false): call notifyConditions() when the inputs of a
+  condition without timeout change. While held, the descriptor idles until
+  resume(); timeToNextTask() caps idle periods at one minute.
+  One SchedulerFd per Scheduler, the scheduler must outlive it.
+
+  addIoTask() waits for a file descriptor to become ready. The waits are
+  multiplexed by a second epoll instance inside fd(); a ready descriptor signals
+  its task (a one-shot signalled task with the usual timeout), so pending waits
+  cost nothing per loop() or dispatch(). Only ready ones are touched.
+  Registrations are tracked per descriptor: one of a task that went away through
+  removeTask() or stop() is replaced by the next addIoTask() on that descriptor,
+  or dropped when the descriptor fires.
+
+  While background tasks have spare time to run in (backgroundReady()), fd() stays
+  readable, each dispatch() runs one background slice.
+*/
+class SchedulerFd {
+public:
+    explicit SchedulerFd(Scheduler& sched) : scheduler(sched) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ioFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0 || timerFd < 0 || eventFd < 0 || ioFd < 0 ||
+            !watch(timerFd) || !watch(eventFd) || !watch(ioFd)) {
+            closeAll();
+            return;
+        }
+        sched.setConditionPolling(false);
+        sched.setWakeHook(&SchedulerFd::wakeHook, this);
+        rearm();
+    }
+    SchedulerFd(const SchedulerFd&) = delete;
+    SchedulerFd& operator=(const SchedulerFd&) = delete;
+    ~SchedulerFd() {
+        for (const auto& w : ioWaits) scheduler.removeTask(w.second); // their timeouts use this
+        if (epollFd >= 0) {
+            scheduler.setWakeHook(nullptr, nullptr);
+            scheduler.setConditionPolling(true);
+        }
+        closeAll();
+    }
+
+    // false if the descriptors could not be created
+    bool valid() const { return epollFd >= 0; }
+    int fd() const { return epollFd; }
+
+    // Run onReady from loop() once fd is ready for events (EPOLLIN, EPOLLOUT, ...).
+    // timeoutMs > 0: not ready within timeoutMs => the task is removed and onTimeout(pid)
+    // called instead. One wait per descriptor at a time: a new one replaces the earlier
+    // wait and removes its task. The descriptor must stay open until the task ran or
+    // timed out. Returns the PID of the task, 0 on failure.
+    PID_t addIoTask(int fd, uint32_t events, std::function<void()> onReady,
+                    uint32_t timeoutMs = 0, std::function<void(PID_t)> onTimeout = nullptr) {
+        if (!valid()) return 0;
+        std::function<void(PID_t)> expired = [this, fd, onTimeout](PID_t pid) {
+            forget(fd, pid);
+            if (onTimeout) onTimeout(pid);
+        };
+        const PID_t pid = scheduler.addSignalledTask(onReady, false, timeoutMs,
+                                                     timeoutMs ? expired : nullptr);
+        if (!pid) return 0;
+        epoll_event ev = {};
+        ev.events = events | EPOLLONESHOT;
+        ev.data.u64 = ((uint64_t)(uint32_t)fd << 32) | (uint32_t)pid;
+        int r = epoll_ctl(ioFd, EPOLL_CTL_ADD, fd, &ev);
+        if (r != 0 && errno == EEXIST) r = epoll_ctl(ioFd, EPOLL_CTL_MOD, fd, &ev); // left over
+        if (r != 0) {
+            scheduler.removeTask(pid);
+            return 0;
+        }
+        auto it = ioWaits.find(fd);
+        if (it != ioWaits.end()) {
+            scheduler.removeTask(it->second); // replaced, false if already gone
+            it->second = pid;
+        } else {
+            ioWaits[fd] = pid;
+        }
+        return pid;
+    }
+
+    // Cancel a pending wait: unregisters fd and removes the task
+    bool removeIoTask(PID_t pid, int fd) {
+        forget(fd, pid);
+        return scheduler.removeTask(pid);
+    }
+
+    // I/O waits that became ready so far
+    uint32_t ioReady() const { return ready; }
+
+    // Run loop() once and re-arm for the next deadline
+    void dispatch() {
+        if (!valid()) return;
+        // drained before loop(): a wake raised while it runs (notifyConditions() from a
+        // callback or another thread) leaves the eventfd set for the next dispatch()
+        drain(timerFd);
+        drain(eventFd);
+        pollIo();
+        scheduler.loop();
+        rearm();
+        dispatched++;
+    }
+
+    uint32_t dispatches() const { return dispatched; }
+
+private:
+    // signal the tasks of ready descriptors, their registration ends here
+    void pollIo() {
+        epoll_event evs[64];
+        int n;
+        do {
+            n = epoll_wait(ioFd, evs, 64, 0);
+            for (int i = 0; i < n; i++) {
+                const int fd = (int)(evs[i].data.u64 >> 32);
+                const PID_t pid = (PID_t)(uint32_t)evs[i].data.u64;
+                if (!forget(fd, pid)) continue; // replaced meanwhile
+                if (scheduler.signalTask(pid)) ready++; // false: removed or timed out meanwhile
+            }
+        } while (n == 64);
+    }
+
+    // unregister fd if its wait belongs to pid
+    bool forget(int fd, PID_t pid) {
+        auto it = ioWaits.find(fd);
+        if (it == ioWaits.end() || it->second != pid) return false;
+        ioWaits.erase(it);
+        if (valid()) epoll_ctl(ioFd, EPOLL_CTL_DEL, fd, nullptr);
+        return true;
+    }
+
+    static void wakeHook(void* context) {
+        const uint64_t one = 1;
+        // may run in another thread; a full counter is still readable
+        const ssize_t r = write(static_cast<SchedulerFd*>(context)->eventFd, &one, sizeof(one));
+        (void)r;
+    }
+
+    void rearm() {
+        const uint32_t ms = scheduler.timeToNextTask();
+        itimerspec its = {};
+        if (ms) {
+            its.it_value.tv_sec = ms / 1000;
+            its.it_value.tv_nsec = (long)(ms % 1000) * 1000000L;
+        }
+        timerfd_settime(timerFd, 0, &its, nullptr); // 0 disarms
+        if (!ms || scheduler.backgroundReady()) wakeHook(this); // due now, or idle time to fill
+    }
+
+    bool watch(int fd) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    static void drain(int fd) {
+        uint64_t v;
+        while (read(fd, &v, sizeof(v)) == (ssize_t)sizeof(v)) {}
+    }
+
+    void closeAll() {
+        if (epollFd >= 0) close(epollFd);
+        if (timerFd >= 0) close(timerFd);
+        if (eventFd >= 0) close(eventFd);
+        if (ioFd >= 0) close(ioFd);
+        epollFd = timerFd = eventFd = ioFd = -1;
+    }
+
+    Scheduler& scheduler;
+    int epollFd = -1;
+    int timerFd = -1;
+    int eventFd = -1;
+    int ioFd = -1;
+    std::unordered_map<int, PID_t> ioWaits; // fd => task of its registration in ioFd
+    uint32_t dispatched = 0;
+    uint32_t ready = 0;
+};
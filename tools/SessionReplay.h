@@ -0,0 +1,288 @@
+// SessionReplay.h
+#pragma once
+// Host only: replays a SessionRecorder log into a Scheduler
+#include <chrono>
+#include <map>
+#include <set>
+#include <vector>
+#include "Scheduler.h"
+
+#if !SCHEDULER_TAP
+#error "SessionReplay.h needs SCHEDULER_TAP"
+#endif
+#include "SessionRecorder.h"
+
+/*
+  The log is decoded into events and fed back in order:
+
+   - outside loop() spans, clock events advance the replayed clock and
+     submissions are re-issued (timed, conditional, signalled tasks, signals,
+     disarms, removals, interval and priority changes, hold / resume,
+     background tasks), with no-op bodies or the ones given by setBody()
+   - a background chunk runs the body given by setBody() instead, its result
+     comes from the log like a condition outcome
+   - for each recorded loop() the driver calls Scheduler::loop(); its clock
+     reads and condition evaluations are answered from the span, and
+     submissions made from task bodies in the field are re-issued at the
+     point they were recorded
+
+  Recorded PIDs are mapped to the PIDs the replayed scheduler hands out, so a
+  changed PID allocation does not matter. If the engine under test reads the
+  clock or evaluates conditions differently than the recorded one, the request
+  is answered from the next matching event of the span (or the last value) and
+  counted as a desync. Bodies given to setBody() must not submit tasks themselves.
+*/
+class SessionReplay : public SchedulerTap {
+public:
+    struct Report {
+        uint32_t loops = 0;
+        uint64_t hostLoopNs = 0;   // host CPU time spent in Scheduler::loop()
+        uint64_t worstLoopNs = 0;
+        uint32_t desyncs = 0;      // requests that did not match the recorded sequence
+        uint32_t overflows = 0;    // events the recorder dropped
+        bool truncated = false;    // no END event
+    };
+
+    // Decode a recorded stream, false if it is not a session log
+    bool load(const uint8_t* data, size_t size) {
+        events.clear();
+        size_t pos = 0;
+        if (size < 3 || data[0] != 'S' || data[1] != 'R' || data[2] != SessionLog::VERSION) return false;
+        pos = 3;
+        if (!varint(data, size, pos, startMs) || !varint(data, size, pos, startUs)) return false;
+        truncated = true;
+        while (pos < size) {
+            Event e;
+            e.type = data[pos++];
+            bool ok = true;
+            if (e.type == SessionLog::END) {
+                truncated = false;
+                break;
+            } else if (e.type == SessionLog::CLOCK_MS || e.type == SessionLog::CLOCK_US ||
+                       e.type == SessionLog::COND_FALSE || e.type == SessionLog::COND_TRUE ||
+                       e.type == SessionLog::OVERFLOW) {
+                ok = varint(data, size, pos, e.value);
+            } else if (e.type >= SchedulerTap::SUBMIT_TIMED && e.type <= SchedulerTap::SUBMIT_BACKGROUND) {
+                ok = varint(data, size, pos, e.value) && varint(data, size, pos, e.a) &&
+                     varint(data, size, pos, e.b) && varint(data, size, pos, e.c);
+            } else if (e.type != SessionLog::LOOP_BEGIN && e.type != SessionLog::LOOP_END) {
+                ok = false;
+            }
+            if (!ok) return false;
+            events.push_back(e);
+        }
+        return true;
+    }
+
+    // Body to run for the task recorded as pid (default: no-op)
+    void setBody(PID_t recordedPID, std::function<void()> body) { bodies[recordedPID] = body; }
+
+    Report run(Scheduler& sched) {
+        Report r;
+        r.truncated = truncated;
+        scheduler = &sched;
+        nowMs = startMs;
+        nowUs = startUs;
+        desyncs = 0;
+        overflows = 0;
+        pidMap.clear();
+        recordedPID.clear();
+        background.clear();
+        sched.setTap(this);
+
+        size_t i = 0;
+        while (i < events.size()) {
+            const Event& e = events[i];
+            if (e.type == SessionLog::LOOP_BEGIN) {
+                spanEnd = i + 1;
+                while (spanEnd < events.size() && events[spanEnd].type != SessionLog::LOOP_END) spanEnd++;
+                cursor = i + 1;
+                inSpan = true;
+                const auto t0 = std::chrono::steady_clock::now();
+                sched.loop();
+                const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t0).count();
+                inSpan = false;
+                r.loops++;
+                r.hostLoopNs += ns;
+                if (ns > r.worstLoopNs) r.worstLoopNs = ns;
+                // what the engine under test did not ask for
+                for (; cursor < spanEnd; cursor++) consume(events[cursor], true);
+                i = spanEnd + 1;
+            } else {
+                consume(e, false);
+                i++;
+            }
+        }
+        sched.setTap(nullptr);
+        scheduler = nullptr;
+        r.desyncs = desyncs;
+        r.overflows = overflows;
+        return r;
+    }
+
+    // SchedulerTap
+    uint32_t clock(bool micro, uint32_t) override {
+        // outside loop() and within re-issued submissions the clock events were
+        // already applied, they precede the submission in the log
+        if (inSpan && !submitting) {
+            const size_t k = find(micro ? SessionLog::CLOCK_US : SessionLog::CLOCK_MS, 0, false);
+            if (k < spanEnd) advanceTo(k);
+        }
+        return micro ? nowUs : nowMs;
+    }
+    bool condition(PID_t pid, const std::function<bool()>&) override {
+        const auto it = recordedPID.find(pid);
+        const uint32_t rec = it != recordedPID.end() ? it->second : pid;
+        const size_t k = find(SessionLog::COND_TRUE, rec, true);
+        if (k >= spanEnd) {
+            desyncs++;
+            return false;
+        }
+        const bool met = events[k].type == SessionLog::COND_TRUE;
+        if (background.count(pid)) {
+            // a chunk runs outside the task list, what it submitted is re-issued
+            const auto b = bodies.find(rec);
+            if (b != bodies.end()) b->second();
+            advanceTo(k);
+            return met;
+        }
+        // conditions are evaluated while the task list is iterated, so never
+        // re-issue a submission from here
+        for (size_t j = cursor; j < k; j++) {
+            if (events[j].type >= SchedulerTap::SUBMIT_TIMED) {
+                desyncs++;
+                return met;
+            }
+        }
+        advanceTo(k);
+        return met;
+    }
+
+private:
+    struct Event {
+        uint8_t type = 0;
+        uint32_t value = 0; // delta, pid or dropped count
+        uint32_t a = 0, b = 0, c = 0;
+    };
+
+    static bool varint(const uint8_t* data, size_t size, size_t& pos, uint32_t& out) {
+        out = 0;
+        for (uint8_t shift = 0; pos < size && shift < 35; shift += 7) {
+            const uint8_t byte = data[pos++];
+            out |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    // next event of type in the current span (conditions: of recorded pid), spanEnd if none
+    size_t find(uint8_t type, uint32_t pid, bool cond) const {
+        for (size_t k = cursor; k < spanEnd; k++) {
+            const Event& e = events[k];
+            if (cond ? ((e.type == SessionLog::COND_TRUE || e.type == SessionLog::COND_FALSE) && e.value == pid)
+                     : e.type == type) return k;
+        }
+        return spanEnd;
+    }
+
+    // consume the span up to and including event k
+    void advanceTo(size_t k) {
+        for (; cursor < k; cursor++) consume(events[cursor], true);
+        const Event& e = events[cursor++];
+        if (e.type == SessionLog::CLOCK_MS) nowMs += e.value;
+        else if (e.type == SessionLog::CLOCK_US) nowUs += e.value;
+    }
+
+    // apply an event that is not the answer to a request
+    void consume(const Event& e, bool skipped) {
+        switch (e.type) {
+            case SessionLog::CLOCK_MS: nowMs += e.value; break;
+            case SessionLog::CLOCK_US: nowUs += e.value; break;
+            case SessionLog::COND_TRUE:
+            case SessionLog::COND_FALSE:
+                if (skipped) desyncs++;
+                break;
+            case SessionLog::OVERFLOW: overflows += e.value; break;
+            default:
+                if (e.type >= SchedulerTap::SUBMIT_TIMED && e.type <= SchedulerTap::SUBMIT_BACKGROUND) submit(e);
+                break;
+        }
+    }
+
+    struct Submitting {
+        bool& flag;
+        explicit Submitting(bool& f) : flag(f) { flag = true; }
+        ~Submitting() { flag = false; }
+    };
+
+    void submit(const Event& e) {
+        Submitting guard(submitting);
+        const PID_t rec = (PID_t)e.value;
+        if (e.type == SchedulerTap::SUBMIT_HOLD) {
+            if (e.a) scheduler->hold();
+            else scheduler->resume();
+            return;
+        }
+        if (e.type == SchedulerTap::SUBMIT_BACKGROUND) {
+            // the chunk is never called, the tap answers for it
+            const PID_t pid = scheduler->addBackgroundTask([](Scheduler::BackgroundSlice&) { return false; });
+            if (!pid) { desyncs++; return; }
+            pidMap[rec] = pid;
+            recordedPID[pid] = rec;
+            background.insert(pid);
+            return;
+        }
+        if (e.type >= SchedulerTap::SUBMIT_SIGNAL) {
+            const auto it = pidMap.find(rec);
+            if (it == pidMap.end()) { desyncs++; return; }
+            bool ok = true;
+            if (e.type == SchedulerTap::SUBMIT_SIGNAL) ok = scheduler->signalTask(it->second, e.a);
+            else if (e.type == SchedulerTap::SUBMIT_DISARM) ok = scheduler->disarmTask(it->second);
+            else if (e.type == SchedulerTap::SUBMIT_INTERVAL) ok = scheduler->setRepeatingTaskInterval(it->second, e.a);
+            else if (e.type == SchedulerTap::SUBMIT_PRIORITY) ok = scheduler->setTaskPriority(it->second, (uint8_t)e.a);
+            else scheduler->removeTask(it->second);
+            if (!ok) desyncs++;
+            return;
+        }
+        std::function<void()> body = []() {};
+        const auto b = bodies.find(rec);
+        if (b != bodies.end()) body = b->second;
+
+        PID_t pid = 0;
+        if (e.type == SchedulerTap::SUBMIT_TIMED) {
+            pid = scheduler->addTimedTask(body, e.a, e.b != 0, e.c);
+        } else if (e.type == SchedulerTap::SUBMIT_CONDITIONAL) {
+            // outcomes come from the log, the condition itself is never called
+            std::function<void(PID_t)> onTimeout = nullptr;
+            if (e.c) onTimeout = [](PID_t) {};
+            pid = scheduler->addConditionalTimedTask(body, []() { return false; }, e.b, e.a, onTimeout);
+        } else {
+            std::function<void(PID_t)> onTimeout = nullptr;
+            if (e.c) onTimeout = [](PID_t) {};
+            pid = scheduler->addSignalledTask(body, e.a != 0, e.b, onTimeout);
+        }
+        if (!pid) { desyncs++; return; }
+        pidMap[rec] = pid;
+        recordedPID[pid] = rec;
+    }
+
+    std::vector<Event> events;
+    uint32_t startMs = 0;
+    uint32_t startUs = 0;
+    bool truncated = false;
+    std::map<PID_t, std::function<void()>> bodies;
+
+    Scheduler* scheduler = nullptr;
+    std::map<PID_t, PID_t> pidMap;      // recorded => replayed
+    std::map<PID_t, PID_t> recordedPID; // replayed => recorded
+    std::set<PID_t> background;         // replayed background tasks
+    uint32_t nowMs = 0;
+    uint32_t nowUs = 0;
+    bool inSpan = false;
+    size_t cursor = 0;
+    size_t spanEnd = 0;
+    bool submitting = false;
+    uint32_t desyncs = 0;
+    uint32_t overflows = 0;
+};
@@ -0,0 +1,39 @@
+// Minimal Arduino/ESP32 shim for building the scheduler into host tools (tools/*.cpp).
+// Not a general Arduino emulation: only what Scheduler.cpp and the headers use.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+
+inline unsigned long micros() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (unsigned long)(uint32_t)duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+inline unsigned long millis() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (unsigned long)(uint32_t)duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+// portMUX critical sections as a recursive mutex
+struct portMUX_TYPE {
+    std::recursive_mutex m;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define taskENTER_CRITICAL(mux) (mux)->m.lock()
+#define taskEXIT_CRITICAL(mux) (mux)->m.unlock()
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t println(const char* s) { return print(s) + print("\n"); }
+};
+
+class Stream : public Print {};
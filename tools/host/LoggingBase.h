@@ -0,0 +1,14 @@
+// Host stand-in for the logger used by Scheduler.cpp, prints to stderr
+#pragma once
+#include <stdio.h>
+
+class LoggingBase {
+public:
+    void println(const char* s) { fprintf(stderr, "%s\n", s); }
+    void println(unsigned long v) { fprintf(stderr, "%lu\n", v); }
+    void print(const char* s) { fputs(s, stderr); }
+    void print(unsigned long v) { fprintf(stderr, "%lu", v); }
+};
+
+// define once in the tool: LoggingBase* gLogger = ...
+extern LoggingBase* gLogger;
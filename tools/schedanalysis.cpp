@@ -0,0 +1,79 @@
+// Host CLI for ScheduleAnalysis.h
+//
+//   g++ -std=c++11 -I.. schedanalysis.cpp -o schedanalysis
+//   ./schedanalysis [-o loopOverheadUs] [-u utilizationBound] [-d] [taskfile]
+//
+// The task file (or stdin) has one repeating task per line, in dispatch order:
+//   <id> <periodMs> <wcetUs>
+// -d: deadline order dispatch (SCHEDULER_INDEXED builds), the file order does not matter.
+// '#' starts a comment. Exit code 0 if the set is schedulable, 1 if not, 2 on usage errors.
+
+#include "ScheduleAnalysis.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage() {
+    std::fprintf(stderr, "usage: schedanalysis [-o loopOverheadUs] [-u utilizationBound] [-d] [taskfile]\n");
+}
+
+int main(int argc, char** argv) {
+    uint32_t overheadUs = 0;
+    float bound = 1.0f;
+    bool deadlineOrder = false;
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-o") && i + 1 < argc) {
+            overheadUs = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "-u") && i + 1 < argc) {
+            bound = std::strtof(argv[++i], nullptr);
+        } else if (!std::strcmp(argv[i], "-d")) {
+            deadlineOrder = true;
+        } else if (argv[i][0] == '-' && argv[i][1]) {
+            usage();
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    FILE* in = path ? std::fopen(path, "r") : stdin;
+    if (!in) {
+        std::perror(path);
+        return 2;
+    }
+
+    std::vector<AnalysisTask> tasks;
+    char line[256];
+    unsigned lineNo = 0;
+    while (std::fgets(line, sizeof(line), in)) {
+        lineNo++;
+        char* hash = std::strchr(line, '#');
+        if (hash) *hash = 0;
+        unsigned long id, period, wcet;
+        const int n = std::sscanf(line, "%lu %lu %lu", &id, &period, &wcet);
+        if (n <= 0) continue; // blank or comment
+        if (n != 3) {
+            std::fprintf(stderr, "line %u: expected <id> <periodMs> <wcetUs>\n", lineNo);
+            return 2;
+        }
+        tasks.push_back(AnalysisTask{(uint32_t)id, (uint32_t)period, (uint32_t)wcet});
+    }
+    if (in != stdin) std::fclose(in);
+
+    const AnalysisReport r = analyzeSchedule(tasks, overheadUs, bound, deadlineOrder);
+
+    std::printf("%8s %10s %10s %12s  %s\n", "id", "period_ms", "wcet_us", "response_us", "verdict");
+    for (const TaskVerdict& v : r.tasks) {
+        std::printf("%8lu %10lu %10lu %12lu  %s\n", (unsigned long)v.id, (unsigned long)v.periodMs,
+                    (unsigned long)v.wcetUs, (unsigned long)v.responseUs,
+                    v.meetsPeriod ? "ok" : "MISSES PERIOD");
+    }
+    std::printf("\nutilization  %.3f (bound %.3f)%s\n", r.utilization, bound,
+                r.overUtilized ? "  OVERLOAD" : "");
+    std::printf("loop burst   %lu us%s\n", (unsigned long)r.burstUs,
+                r.tickOverload ? "  exceeds the shortest period" : "");
+    std::printf("schedulable  %s\n", r.schedulable ? "yes" : "no");
+    return r.schedulable ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// Host benchmark of the task list operations at growing task counts
+//
+//   g++ -O2 -std=c++11 -Ihost -I. -I.. -DSCHEDULER_INDEXED=1 -DSCHEDULER_SEQUENTIAL=0
+//       -DSCHEDULER_PID_TYPE=uint32_t -DSCHEDULER_MAX_TASKS=1000000
+//       ../Scheduler.cpp schedbench.cpp -o schedbench
+//   ./schedbench [tasks ...]      (default 1000 10000 100000)
+//
+// Build without -DSCHEDULER_INDEXED=1 to measure the plain task list. Each run adds
+// n repeating timers with period n ms, staggered so one falls due per ms, and drives
+// loop() from a virtual clock (through SchedulerTap) one ms per call. Prints the mean
+// host time per operation in ns.
+
+#include "Scheduler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <LoggingBase.h>
+
+static LoggingBase hostLogger;
+LoggingBase* gLogger = &hostLogger;
+
+#if !SCHEDULER_TAP
+#error "schedbench needs SCHEDULER_TAP for its virtual clock"
+#endif
+
+class VirtualClock : public SchedulerTap {
+public:
+    uint32_t ms = 1;
+    uint32_t clock(bool micro, uint32_t) override { return micro ? ms * 1000 : ms; }
+};
+
+static uint64_t nowNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void bench(uint32_t n, uint32_t loops) {
+    Scheduler sched;
+    VirtualClock clk;
+    sched.setTap(&clk);
+    std::vector<PID_t> pids;
+    pids.reserve(n);
+    uint32_t runs = 0;
+
+    uint64_t t0 = nowNs();
+    for (uint32_t i = 0; i < n; i++) {
+        pids.push_back(sched.addTimedTask([&runs]() { runs++; }, i + 1, true, n));
+    }
+    const double addNs = (double)(nowNs() - t0) / n;
+
+    sched.loop(); // arms all of them
+    t0 = nowNs();
+    for (uint32_t i = 0; i < loops; i++) {
+        clk.ms++;
+        sched.loop();
+    }
+    const double loopNs = (double)(nowNs() - t0) / loops;
+
+    const uint32_t lookups = 10000;
+    uint32_t found = 0;
+    t0 = nowNs();
+    for (uint32_t i = 0; i < lookups; i++) {
+        found += sched.setTaskPriority(pids[(i * 7919u) % n], Scheduler::PRIORITY_NORMAL);
+    }
+    const double lookupNs = (double)(nowNs() - t0) / lookups;
+
+    volatile uint32_t sink = 0;
+    t0 = nowNs();
+    for (uint32_t i = 0; i < lookups; i++) sink = sink + sched.timeToNextTask();
+    const double nextNs = (double)(nowNs() - t0) / lookups;
+
+    t0 = nowNs();
+    for (uint32_t i = 0; i < n; i++) sched.removeTask(pids[i]);
+    sched.loop(); // applies the removals
+    const double removeNs = (double)(nowNs() - t0) / n;
+
+    sched.setTap(nullptr);
+    std::printf("%8u %10.0f %10.0f %10.0f %10.0f %10.0f   runs=%u found=%u left=%u\n",
+                n, addNs, removeNs, lookupNs, nextNs, loopNs,
+                runs, found, (unsigned)sched.taskCount());
+}
+
+int main(int argc, char** argv) {
+    std::vector<uint32_t> sizes;
+    for (int i = 1; i < argc; i++) sizes.push_back(std::strtoul(argv[i], nullptr, 10));
+    if (sizes.empty()) sizes = { 1000, 10000, 100000 };
+
+    std::printf("%s task list, PID_t %u bytes\n",
+                SCHEDULER_INDEXED ? "indexed" : "plain", (unsigned)sizeof(PID_t));
+    std::printf("%8s %10s %10s %10s %10s %10s   (ns per operation)\n",
+                "tasks", "add", "remove", "lookup", "next", "loop");
+    for (uint32_t n : sizes) {
+        if (!n || n > SCHEDULER_MAX_TASKS) {
+            std::fprintf(stderr, "skipping %u tasks, SCHEDULER_MAX_TASKS is %lu\n",
+                         n, (unsigned long)SCHEDULER_MAX_TASKS);
+            continue;
+        }
+        bench(n, 2000);
+    }
+    return 0;
+}
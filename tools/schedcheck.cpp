@@ -0,0 +1,102 @@
+// Host checks of the scheduler and its helpers
+//
+//   g++ -std=c++11 -Ihost -I. -I.. ../Scheduler.cpp schedcheck.cpp -o schedcheck
+//   ./schedcheck
+//
+// Each check drives a fresh Scheduler with a manual clock (through the tap) and
+// checks a sequence that once went wrong. Prints one line per check. Exit code 0
+// if all passed, 1 otherwise.
+
+#include "Scheduler.h"
+#include "Channel.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <LoggingBase.h>
+
+static LoggingBase hostLogger;
+LoggingBase* gLogger = &hostLogger;
+
+// time only moves when the check advances it
+class ManualClock : public SchedulerTap {
+public:
+    uint32_t ms = 1000;
+    uint32_t clock(bool micro, uint32_t) override { return micro ? ms * 1000 : ms; }
+};
+
+// advance by stepMs and run loop() until ms passed
+static void runFor(Scheduler& sched, ManualClock& clk, uint32_t ms, uint32_t stepMs = 1) {
+    for (uint32_t t = 0; t < ms; t += stepMs) {
+        clk.ms += stepMs;
+        sched.loop();
+    }
+}
+
+static int failures = 0;
+
+static void report(const char* name, bool ok) {
+    std::printf("%-44s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+// the old consumer was armed but never ran, a new one must still be signalled
+static void channelReattach() {
+    Scheduler sched;
+    ManualClock clk;
+    sched.setTap(&clk);
+    Channel<int, 8> ch;
+    int consumed = 0;
+    ch.attach(sched, [&consumed](const int&) { consumed++; });
+    ch.push(1);
+    ch.detach();
+    ch.attach(sched, [&consumed](const int&) { consumed++; });
+    for (int i = 0; i < 3; i++) ch.push(i);
+    runFor(sched, clk, 5);
+    report("Channel re-attach with an armed consumer", consumed == 4 && ch.empty());
+}
+
+// jitter off: retries 1, 3, 7, 12, 17 s after the first attempt, then onFailure
+static void retryBackoff() {
+    Scheduler sched;
+    ManualClock clk;
+    sched.setTap(&clk);
+    Scheduler::RetryPolicy policy;
+    policy.initialDelayMs = 1000;
+    policy.maxDelayMs = 5000;
+    policy.jitterPercent = 0;
+    policy.maxAttempts = 6;
+    std::vector<uint32_t> at;
+    uint32_t failedAt = 0;
+    const uint32_t start = clk.ms;
+    sched.addRetryTask([&]() { at.push_back(clk.ms - start); return false; }, policy,
+                       [&](PID_t) { failedAt = clk.ms - start; });
+    runFor(sched, clk, 20000);
+    const std::vector<uint32_t> expected = {0, 1000, 3000, 7000, 12000, 17000};
+    report("retry backoff 1/3/7/12/17 s", at.size() == expected.size() &&
+           std::equal(at.begin(), at.end(), expected.begin(), [](uint32_t a, uint32_t e) {
+               return a >= e && a <= e + 1;
+           }) && failedAt >= 17000 && failedAt <= 17001);
+}
+
+// delays past 2^31 ms and jitter over 100 % must not come out as (almost) no delay
+static void retryLongDelay() {
+    Scheduler sched;
+    ManualClock clk;
+    sched.setTap(&clk);
+    Scheduler::RetryPolicy policy;
+    policy.initialDelayMs = 3000000000UL;
+    policy.maxDelayMs = 0;
+    policy.maxAttempts = 0;
+    policy.jitterPercent = 255;
+    uint32_t attempts = 0;
+    sched.addRetryTask([&attempts]() { attempts++; return false; }, policy);
+    runFor(sched, clk, 300);
+    report("retry delay beyond 2^31 ms, jitter 255 %", attempts == 1);
+}
+
+int main() {
+    channelReattach();
+    retryBackoff();
+    retryLongDelay();
+    return failures ? 1 : 0;
+}
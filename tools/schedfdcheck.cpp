@@ -0,0 +1,96 @@
+// Host checks of SchedulerFd wakeups
+//
+//   g++ -std=c++11 -Ihost -I. -I.. ../Scheduler.cpp schedfdcheck.cpp -o schedfdcheck
+//   ./schedfdcheck
+//
+// Drives a Scheduler only through SchedulerFd and epoll, like an application event
+// loop, and checks that work submitted at awkward moments is not lost. Prints one
+// line per check. Exit code 0 if all passed, 1 otherwise.
+
+#include "SchedulerFd.h"
+#include <chrono>
+#include <cstdio>
+#include <LoggingBase.h>
+
+static LoggingBase hostLogger;
+LoggingBase* gLogger = &hostLogger;
+
+static uint64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// dispatch whenever the descriptor is readable, until done() or timeoutMs passed
+template<typename Done>
+static bool runUntil(SchedulerFd& sfd, uint32_t timeoutMs, Done done) {
+    const int ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sfd.fd(), &ev);
+    const uint64_t end = nowMs() + timeoutMs;
+    while (!done() && nowMs() < end) {
+        epoll_event r;
+        if (epoll_wait(ep, &r, 1, (int)(end - nowMs())) > 0) sfd.dispatch();
+    }
+    close(ep);
+    return done();
+}
+
+static int failures = 0;
+
+static void report(const char* name, bool ok) {
+    std::printf("%-44s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+// notifyConditions() from a callback while loop() runs
+static void notifyFromCallback() {
+    Scheduler sched;
+    SchedulerFd sfd(sched);
+    bool flag = false;
+    bool ran = false;
+    sched.addConditionalTask([&ran]() { ran = true; }, [&flag]() { return flag; });
+    sched.addTimedTask([&]() { flag = true; sched.notifyConditions(); }, 50);
+    sched.addTimedTask([]() {}, 5000); // keeps the timerfd far away
+    report("notifyConditions() from a callback", runUntil(sfd, 1000, [&ran]() { return ran; }));
+}
+
+// a background task added while the descriptor idles until a far deadline
+static void backgroundWhileIdle() {
+    Scheduler sched;
+    SchedulerFd sfd(sched);
+    sched.addTimedTask([]() {}, 5000);
+    runUntil(sfd, 50, []() { return false; }); // settle: nothing due for 5 s
+    int chunks = 0;
+    sched.addBackgroundTask([&chunks](Scheduler::BackgroundSlice&) { chunks++; return false; });
+    report("background task added while idle", runUntil(sfd, 1000, [&chunks]() { return chunks > 0; }));
+}
+
+// an I/O wait whose task went through removeTask(), then a new wait on the same descriptor
+static void ioWaitAfterRemoveTask() {
+    Scheduler sched;
+    SchedulerFd sfd(sched);
+    int p[2];
+    if (pipe(p) != 0) {
+        report("I/O wait after removeTask()", false);
+        return;
+    }
+    bool stale = false;
+    bool ran = false;
+    sched.removeTask(sfd.addIoTask(p[0], EPOLLIN, [&stale]() { stale = true; }));
+    runUntil(sfd, 20, []() { return false; });
+    const PID_t pid = sfd.addIoTask(p[0], EPOLLIN, [&ran]() { ran = true; });
+    const char c = 'x';
+    const bool written = write(p[1], &c, 1) == 1;
+    report("I/O wait after removeTask()",
+           pid && written && runUntil(sfd, 1000, [&ran]() { return ran; }) && !stale);
+    close(p[0]);
+    close(p[1]);
+}
+
+int main() {
+    notifyFromCallback();
+    backgroundWhileIdle();
+    ioWaitAfterRemoveTask();
+    return failures ? 1 : 0;
+}
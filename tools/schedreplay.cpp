@@ -0,0 +1,82 @@
+// Host replay driver for SessionRecorder logs
+//
+//   g++ -std=c++11 -Ihost -I. -I.. ../Scheduler.cpp schedreplay.cpp -o schedreplay
+//   ./schedreplay [-n repetitions] session.bin
+//
+// Replays the recorded session into a fresh Scheduler built from the sources it
+// is compiled with, so the same log can be run against different engine versions.
+// Prints the scheduler metrics (deterministic for a given engine) and the host
+// CPU time of loop(). Exit code 0 on an exact replay, 1 on desyncs or an
+// incomplete log, 2 on usage errors.
+
+#include "SessionReplay.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <LoggingBase.h>
+
+static LoggingBase hostLogger;
+LoggingBase* gLogger = &hostLogger;
+
+static void usage() {
+    std::fprintf(stderr, "usage: schedreplay [-n repetitions] session.bin\n");
+}
+
+int main(int argc, char** argv) {
+    unsigned long reps = 1;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-n") && i + 1 < argc) {
+            reps = std::strtoul(argv[++i], nullptr, 10);
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path || !reps) {
+        usage();
+        return 2;
+    }
+
+    FILE* in = std::fopen(path, "rb");
+    if (!in) {
+        std::perror(path);
+        return 2;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), in)) > 0) data.insert(data.end(), chunk, chunk + n);
+    std::fclose(in);
+
+    SessionReplay replay;
+    if (!replay.load(data.data(), data.size())) {
+        std::fprintf(stderr, "%s: not a session log or corrupt\n", path);
+        return 2;
+    }
+
+    SessionReplay::Report r;
+    Scheduler::Metrics m;
+    uint64_t bestNs = UINT64_MAX;
+    for (unsigned long k = 0; k < reps; k++) {
+        Scheduler sched;
+        r = replay.run(sched);
+        m = sched.metrics();
+        if (r.hostLoopNs < bestNs) bestNs = r.hostLoopNs;
+    }
+
+    std::printf("loops            %lu\n", (unsigned long)r.loops);
+    std::printf("dispatched       %lu\n", (unsigned long)m.dispatched);
+    std::printf("condition evals  %lu\n", (unsigned long)m.conditionEvals);
+    std::printf("timeouts         %lu\n", (unsigned long)m.timeouts);
+    std::printf("work calls       %lu\n", (unsigned long)m.workCalls);
+    std::printf("max lateness     %lu ms\n", (unsigned long)m.maxLatenessMs);
+    std::printf("host loop time   %.1f us total, %.3f us/loop, worst %.1f us (best of %lu)\n",
+                bestNs / 1000.0, r.loops ? bestNs / 1000.0 / r.loops : 0.0, r.worstLoopNs / 1000.0, reps);
+    std::printf("desyncs          %lu\n", (unsigned long)r.desyncs);
+    if (r.overflows) std::printf("dropped events   %lu (recorder buffer overflow)\n", (unsigned long)r.overflows);
+    if (r.truncated) std::printf("log has no END event, truncated\n");
+    return r.desyncs || r.overflows || r.truncated ? 1 : 0;
+}